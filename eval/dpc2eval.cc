@@ -0,0 +1,719 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes an evaluator that runs many prefetcher configurations
+  over the same trace at once, in a single process.
+
+  The trace is read from stdin and decoded once, into a read-only array of
+  memory accesses shared by every configuration.  Each configuration is a
+  prefetcher built as a shared object (see the dpc2eval-%.so rule in the
+  Makefile), and is given to the evaluator on the command line.  Example
+  prefetchers keep their state in global variables, so each configuration
+  is loaded from its own private copy of its shared object, which gives it
+  its own copy of those globals.  The same shared object may be listed more
+  than once.
+
+  Each configuration is run against its own functional cache model: an L1D
+  that filters accesses, the L2 the prefetcher sits in, and an LLC.  The
+  model has no timing.  get_current_cycle() returns the number of
+  instructions executed so far, and the MSHR and read queue occupancies are
+  always 0, so the evaluator measures prefetch coverage and accuracy, not
+  IPC.  Use the simulator to measure IPC for the configurations that look
+  promising.
+
+  Configurations are run by a pool of worker threads, which each take the
+  next configuration that has not been started.  A worker allocates all of
+  a configuration's state itself, its counters as well as its cache model,
+  so that on NUMA machines the memory is first touched by, and so local
+  to, the core running it.  That state is aligned to a cache line so that
+  workers never share one.
+
+  Usage: zcat trace.dpc.gz | ./dpc2eval [options] config1.so config2.so ...
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "../inc/prefetcher.h"
+
+#define L1D_SETS 64
+#define L1D_WAYS 8
+#define LLC_WAYS 16
+#define LLC_SETS_DEFAULT 1024
+#define LLC_SETS_SMALL 256
+
+// the most prefetches a single l2_prefetcher_operate() call may issue
+#define PENDING_FILL_COUNT 64
+
+typedef struct trace_record
+{
+  unsigned long long int ip;
+  unsigned char destination_register;
+  unsigned char source_registers[3];
+  unsigned char unused[4];
+  unsigned long long int destination_memory;
+  unsigned long long int source_memory[3];
+} trace_record_t;
+
+typedef struct memory_access
+{
+  unsigned long long int ip;
+  unsigned long long int addr;
+  // instructions retired before this access, used as the cycle count
+  unsigned long long int instruction;
+} memory_access_t;
+
+typedef struct cache_line
+{
+  // cache line address, 0 if invalid
+  unsigned long long int line;
+  unsigned long long int lru;
+  // set while a prefetched line has not yet been used by a demand access
+  int prefetched;
+} cache_line_t;
+
+typedef struct cache
+{
+  cache_line_t *lines;
+  int sets;
+  int ways;
+  unsigned long long int lru_clock;
+} cache_t;
+
+typedef struct pending_fill
+{
+  unsigned long long int addr;
+  int set;
+  int way;
+  unsigned long long int evicted_addr;
+} pending_fill_t;
+
+typedef struct prefetcher_api
+{
+  void (*initialize)(int);
+  void (*operate)(int, unsigned long long int, unsigned long long int, int);
+  void (*cache_fill)(int, unsigned long long int, int, int, int, unsigned long long int);
+  void (*final_stats)(int);
+} prefetcher_api_t;
+
+// everything one configuration owns while it runs, aligned so that no two instances share a cache line
+typedef struct instance
+{
+  const char *name;
+  const char *path;
+
+  cache_t l1d;
+  cache_t l2;
+  cache_t llc;
+
+  unsigned long long int cycle;
+  pending_fill_t pending_fills[PENDING_FILL_COUNT];
+  int pending_fill_count;
+
+  // results
+  unsigned long long int l2_accesses;
+  unsigned long long int l2_misses;
+  unsigned long long int prefetches_l2;
+  unsigned long long int prefetches_llc;
+  unsigned long long int prefetches_redundant;
+  unsigned long long int prefetches_rejected;
+  unsigned long long int useful_l2;
+  unsigned long long int useful_llc;
+  unsigned long long int useless_evicted;
+  // prefetch fills from a single access beyond PENDING_FILL_COUNT, which the prefetcher never sees
+  unsigned long long int fills_unreported;
+  double seconds;
+  int failed;
+} __attribute__((aligned(64))) instance_t;
+
+int knob_low_bandwidth = 0;
+int knob_small_llc = 0;
+int knob_scramble_loads = 0;
+
+// the decoded trace, shared read-only by every worker
+memory_access_t *accesses;
+unsigned long long int access_count;
+
+// the shared object path of each configuration, and its state, allocated by the worker that runs it
+const char **instance_paths;
+instance_t **instances;
+int instance_count;
+int next_instance;
+pthread_mutex_t next_instance_lock = PTHREAD_MUTEX_INITIALIZER;
+// dlopen() and the prefetchers' printing aren't worth running concurrently
+pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the instance running on this thread, which the simulator functions below act on
+__thread instance_t *current;
+
+void cache_initialize(cache_t *cache, int sets, int ways)
+{
+  cache->sets = sets;
+  cache->ways = ways;
+  cache->lru_clock = 0;
+  cache->lines = (cache_line_t *)calloc(sets*ways, sizeof(cache_line_t));
+}
+
+void cache_free(cache_t *cache)
+{
+  free(cache->lines);
+  cache->lines = NULL;
+}
+
+int cache_set(cache_t *cache, unsigned long long int line)
+{
+  return line & (cache->sets-1);
+}
+
+// returns the line if it is in the cache, and marks it most recently used
+cache_line_t *cache_find(cache_t *cache, unsigned long long int line, int *way)
+{
+  cache_line_t *set = &cache->lines[cache_set(cache, line)*cache->ways];
+  int i;
+  for(i=0; i<cache->ways; i++)
+    {
+      if(set[i].line == line)
+	{
+	  set[i].lru = ++cache->lru_clock;
+	  if(way != NULL)
+	    {
+	      *way = i;
+	    }
+	  return &set[i];
+	}
+    }
+  return NULL;
+}
+
+// returns the line if it is in the cache, without changing replacement state
+cache_line_t *cache_probe(cache_t *cache, unsigned long long int line, int *way)
+{
+  cache_line_t *set = &cache->lines[cache_set(cache, line)*cache->ways];
+  int i;
+  for(i=0; i<cache->ways; i++)
+    {
+      if(set[i].line == line)
+	{
+	  if(way != NULL)
+	    {
+	      *way = i;
+	    }
+	  return &set[i];
+	}
+    }
+  return NULL;
+}
+
+// fills a line that is not already in the cache, replacing the LRU way
+cache_line_t *cache_fill(cache_t *cache, unsigned long long int line, int prefetched, int *way, cache_line_t *evicted)
+{
+  cache_line_t *set = &cache->lines[cache_set(cache, line)*cache->ways];
+  int victim = 0;
+  int i;
+  for(i=1; i<cache->ways; i++)
+    {
+      if(set[i].lru < set[victim].lru)
+	{
+	  victim = i;
+	}
+    }
+
+  if(evicted != NULL)
+    {
+      *evicted = set[victim];
+    }
+
+  set[victim].line = line;
+  set[victim].lru = ++cache->lru_clock;
+  set[victim].prefetched = prefetched;
+  if(way != NULL)
+    {
+      *way = victim;
+    }
+  return &set[victim];
+}
+
+// fills a line into the L2, and queues the l2_cache_fill() call for the prefetcher
+void l2_fill(instance_t *in, unsigned long long int line, int prefetched)
+{
+  int way = 0;
+  cache_line_t evicted;
+  cache_fill(&in->l2, line, prefetched, &way, &evicted);
+  if(evicted.prefetched)
+    {
+      in->useless_evicted++;
+    }
+
+  if(in->pending_fill_count < PENDING_FILL_COUNT)
+    {
+      pending_fill_t *fill = &in->pending_fills[in->pending_fill_count];
+      fill->addr = line<<6;
+      fill->set = cache_set(&in->l2, line);
+      fill->way = way;
+      fill->evicted_addr = evicted.line<<6;
+      in->pending_fill_count++;
+    }
+  else
+    {
+      in->fills_unreported++;
+    }
+}
+
+/*
+  The simulator functions that prefetchers call, answered from the current thread's instance.
+*/
+
+unsigned long long int get_current_cycle(int cpu_num)
+{
+  return current->cycle;
+}
+
+int get_l2_mshr_occupancy(int cpu_num)
+{
+  return 0;
+}
+
+int get_l2_read_queue_occupancy(int cpu_num)
+{
+  return 0;
+}
+
+int l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  instance_t *in = current;
+
+  if((base_addr>>12) != (pf_addr>>12))
+    {
+      in->prefetches_rejected++;
+      return 0;
+    }
+
+  unsigned long long int line = pf_addr>>6;
+  if(cache_probe(&in->l2, line, NULL) != NULL)
+    {
+      in->prefetches_redundant++;
+      return 1;
+    }
+
+  if(fill_level == FILL_L2)
+    {
+      in->prefetches_l2++;
+      l2_fill(in, line, 1);
+      // the line also passes through the LLC on its way to the L2
+      cache_line_t *llc_line = cache_find(&in->llc, line, NULL);
+      if(llc_line == NULL)
+	{
+	  cache_fill(&in->llc, line, 0, NULL, NULL);
+	}
+      else
+	{
+	  // an earlier LLC prefetch of this line is only useful if a demand access uses the line,
+	  // and that is counted once, for this prefetch, when it hits in the L2
+	  llc_line->prefetched = 0;
+	}
+    }
+  else if(fill_level == FILL_LLC)
+    {
+      if(cache_probe(&in->llc, line, NULL) != NULL)
+	{
+	  in->prefetches_redundant++;
+	  return 1;
+	}
+      in->prefetches_llc++;
+      cache_fill(&in->llc, line, 1, NULL, NULL);
+    }
+  else
+    {
+      in->prefetches_rejected++;
+      return 0;
+    }
+  return 1;
+}
+
+int l2_get_set(unsigned long long int addr)
+{
+  return (addr>>6) & (L2_SET_COUNT-1);
+}
+
+int l2_get_way(int cpu_num, unsigned long long int addr, int set)
+{
+  int way = -1;
+  if(cache_probe(&current->l2, addr>>6, &way) == NULL)
+    {
+      return -1;
+    }
+  return way;
+}
+
+/*
+  Trace decoding, and running one instance over the decoded trace.
+*/
+
+void read_trace(unsigned long long int instruction_limit)
+{
+  unsigned long long int capacity = 1<<20;
+  accesses = (memory_access_t *)malloc(capacity * sizeof(memory_access_t));
+  access_count = 0;
+
+  trace_record_t records[4096];
+  unsigned long long int instruction = 0;
+  size_t count;
+  while((instruction < instruction_limit) && ((count = fread(records, sizeof(trace_record_t), 4096, stdin)) > 0))
+    {
+      size_t r;
+      for(r=0; (r<count) && (instruction<instruction_limit); r++, instruction++)
+	{
+	  unsigned long long int addrs[4] = { records[r].source_memory[0], records[r].source_memory[1],
+					      records[r].source_memory[2], records[r].destination_memory };
+	  int i;
+	  for(i=0; i<4; i++)
+	    {
+	      if(addrs[i] == 0)
+		{
+		  continue;
+		}
+	      if(access_count == capacity)
+		{
+		  capacity *= 2;
+		  accesses = (memory_access_t *)realloc(accesses, capacity * sizeof(memory_access_t));
+		}
+	      accesses[access_count].ip = records[r].ip;
+	      accesses[access_count].addr = addrs[i];
+	      accesses[access_count].instruction = instruction;
+	      access_count++;
+	    }
+	}
+    }
+}
+
+// loads a private copy of the shared object, so that this instance has its own globals
+void *load_private_copy(const char *path)
+{
+  char copy_path[] = "/tmp/dpc2eval-XXXXXX";
+  int out = mkstemp(copy_path);
+  if(out < 0)
+    {
+      fprintf(stderr, "Couldn't copy %s\n", path);
+      return NULL;
+    }
+  int in = open(path, O_RDONLY);
+  if(in < 0)
+    {
+      fprintf(stderr, "Couldn't open %s\n", path);
+      close(out);
+      unlink(copy_path);
+      return NULL;
+    }
+
+  char buffer[65536];
+  ssize_t n;
+  while((n = read(in, buffer, sizeof(buffer))) > 0)
+    {
+      if(write(out, buffer, n) != n)
+	{
+	  n = -1;
+	  break;
+	}
+    }
+  close(in);
+  close(out);
+
+  void *handle = NULL;
+  if(n == 0)
+    {
+      handle = dlopen(copy_path, RTLD_NOW | RTLD_LOCAL);
+      if(handle == NULL)
+	{
+	  fprintf(stderr, "Couldn't load %s: %s\n", path, dlerror());
+	}
+    }
+  unlink(copy_path);
+  return handle;
+}
+
+void run_instance(int index)
+{
+  instance_t *in;
+  if(posix_memalign((void **)&in, 64, sizeof(instance_t)) != 0)
+    {
+      fprintf(stderr, "Couldn't allocate an instance for %s\n", instance_paths[index]);
+      exit(1);
+    }
+  memset(in, 0, sizeof(instance_t));
+  in->path = instance_paths[index];
+  in->name = strrchr(in->path, '/') ? strrchr(in->path, '/')+1 : in->path;
+  instances[index] = in;
+
+  // CPU time rather than wall time, so that instances sharing a core aren't charged for each other
+  struct timespec start, end;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+  pthread_mutex_lock(&load_lock);
+  void *handle = load_private_copy(in->path);
+  prefetcher_api_t api;
+  if(handle != NULL)
+    {
+      api.initialize = (void (*)(int))dlsym(handle, "l2_prefetcher_initialize");
+      api.operate = (void (*)(int, unsigned long long int, unsigned long long int, int))dlsym(handle, "l2_prefetcher_operate");
+      api.cache_fill = (void (*)(int, unsigned long long int, int, int, int, unsigned long long int))dlsym(handle, "l2_cache_fill");
+      api.final_stats = (void (*)(int))dlsym(handle, "l2_prefetcher_final_stats");
+    }
+  if((handle == NULL) || !api.initialize || !api.operate || !api.cache_fill || !api.final_stats)
+    {
+      if(handle != NULL)
+	{
+	  dlclose(handle);
+	}
+      pthread_mutex_unlock(&load_lock);
+      fprintf(stderr, "%s is not a prefetcher\n", in->path);
+      in->failed = 1;
+      return;
+    }
+
+  // allocated by the thread that runs this instance, so that first touch places it in local memory
+  cache_initialize(&in->l1d, L1D_SETS, L1D_WAYS);
+  cache_initialize(&in->l2, L2_SET_COUNT, L2_ASSOCIATIVITY);
+  cache_initialize(&in->llc, knob_small_llc ? LLC_SETS_SMALL : LLC_SETS_DEFAULT, LLC_WAYS);
+
+  current = in;
+  // prefetchers print a banner when initialized, so keep them from interleaving
+  printf("== %s\n", in->name);
+  api.initialize(0);
+  fflush(stdout);
+  pthread_mutex_unlock(&load_lock);
+
+  unsigned long long int i;
+  for(i=0; i<access_count; i++)
+    {
+      const memory_access_t *access = &accesses[i];
+      unsigned long long int line = access->addr>>6;
+      in->cycle = access->instruction;
+
+      if(cache_find(&in->l1d, line, NULL) != NULL)
+	{
+	  continue;
+	}
+      cache_fill(&in->l1d, line, 0, NULL, NULL);
+
+      in->l2_accesses++;
+      in->pending_fill_count = 0;
+
+      cache_line_t *l2_line = cache_find(&in->l2, line, NULL);
+      if(l2_line != NULL)
+	{
+	  if(l2_line->prefetched)
+	    {
+	      in->useful_l2++;
+	      l2_line->prefetched = 0;
+	    }
+	  api.operate(0, access->addr, access->ip, 1);
+	}
+      else
+	{
+	  in->l2_misses++;
+	  cache_line_t *llc_line = cache_find(&in->llc, line, NULL);
+	  if(llc_line == NULL)
+	    {
+	      cache_fill(&in->llc, line, 0, NULL, NULL);
+	    }
+	  else if(llc_line->prefetched)
+	    {
+	      in->useful_llc++;
+	      llc_line->prefetched = 0;
+	    }
+
+	  // the prefetcher sees the miss before the demand fill, and any prefetches it issues
+	  // are filled after that, as they would be in the simulator
+	  api.operate(0, access->addr, access->ip, 0);
+	  pending_fill_t prefetch_fills[PENDING_FILL_COUNT];
+	  int prefetch_fill_count = in->pending_fill_count;
+	  memcpy(prefetch_fills, in->pending_fills, prefetch_fill_count * sizeof(pending_fill_t));
+
+	  in->pending_fill_count = 0;
+	  cache_line_t *filled = cache_probe(&in->l2, line, NULL);
+	  if(filled == NULL)
+	    {
+	      l2_fill(in, line, 0);
+	      api.cache_fill(0, line<<6, in->pending_fills[0].set, in->pending_fills[0].way, 0, in->pending_fills[0].evicted_addr);
+	    }
+	  else
+	    {
+	      // the prefetcher prefetched the line that just missed, which the demand miss already fetches
+	      filled->prefetched = 0;
+	    }
+	  memcpy(in->pending_fills, prefetch_fills, prefetch_fill_count * sizeof(pending_fill_t));
+	  in->pending_fill_count = prefetch_fill_count;
+	}
+
+      int f;
+      for(f=0; f<in->pending_fill_count; f++)
+	{
+	  pending_fill_t *fill = &in->pending_fills[f];
+	  api.cache_fill(0, fill->addr, fill->set, fill->way, 1, fill->evicted_addr);
+	}
+    }
+
+  // the prefetcher's own stats go to stderr with its banner, one instance at a time
+  pthread_mutex_lock(&load_lock);
+  printf("== %s\n", in->name);
+  api.final_stats(0);
+  fflush(stdout);
+  pthread_mutex_unlock(&load_lock);
+
+  current = NULL;
+  cache_free(&in->l1d);
+  cache_free(&in->l2);
+  cache_free(&in->llc);
+  dlclose(handle);
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+  in->seconds = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+}
+
+void *worker(void *arg)
+{
+  while(1)
+    {
+      pthread_mutex_lock(&next_instance_lock);
+      int index = next_instance++;
+      pthread_mutex_unlock(&next_instance_lock);
+
+      if(index >= instance_count)
+	{
+	  return NULL;
+	}
+      run_instance(index);
+    }
+}
+
+void print_usage()
+{
+  fprintf(stderr, "Usage: dpc2eval [options] config1.so config2.so ... < trace.dpc\n");
+  fprintf(stderr, "  -threads <number>                  worker threads (default: number of online cores)\n");
+  fprintf(stderr, "  -simulation_instructions <number>  instructions to decode from the trace (default: all)\n");
+  fprintf(stderr, "  -small_llc, -low_bandwidth, -scramble_loads  set the knobs visible to prefetchers\n");
+}
+
+int main(int argc, char **argv)
+{
+  int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned long long int instruction_limit = ~0ULL;
+
+  instance_paths = (const char **)calloc(argc, sizeof(const char *));
+  instances = (instance_t **)calloc(argc, sizeof(instance_t *));
+  instance_count = 0;
+
+  int i;
+  for(i=1; i<argc; i++)
+    {
+      if((strcmp(argv[i], "-threads") == 0) && (i+1 < argc))
+	{
+	  thread_count = atoi(argv[++i]);
+	}
+      else if((strcmp(argv[i], "-simulation_instructions") == 0) && (i+1 < argc))
+	{
+	  instruction_limit = strtoull(argv[++i], NULL, 0);
+	}
+      else if(strcmp(argv[i], "-small_llc") == 0)
+	{
+	  knob_small_llc = 1;
+	}
+      else if(strcmp(argv[i], "-low_bandwidth") == 0)
+	{
+	  knob_low_bandwidth = 1;
+	}
+      else if(strcmp(argv[i], "-scramble_loads") == 0)
+	{
+	  knob_scramble_loads = 1;
+	}
+      else if(argv[i][0] == '-')
+	{
+	  print_usage();
+	  return 1;
+	}
+      else
+	{
+	  instance_paths[instance_count++] = argv[i];
+	}
+    }
+
+  if((instance_count == 0) || (thread_count < 1))
+    {
+      print_usage();
+      return 1;
+    }
+  if(thread_count > instance_count)
+    {
+      thread_count = instance_count;
+    }
+
+  struct timespec start, decoded, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  read_trace(instruction_limit);
+  clock_gettime(CLOCK_MONOTONIC, &decoded);
+
+  // the prefetchers' own printing would interleave between threads, so send it to stderr
+  fflush(stdout);
+  int saved_stdout = dup(1);
+  dup2(2, 1);
+
+  pthread_t *threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+  for(i=0; i<thread_count; i++)
+    {
+      pthread_create(&threads[i], NULL, worker, NULL);
+    }
+  for(i=0; i<thread_count; i++)
+    {
+      pthread_join(threads[i], NULL);
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  fflush(stdout);
+  dup2(saved_stdout, 1);
+
+  double decode_seconds = (decoded.tv_sec-start.tv_sec) + (decoded.tv_nsec-start.tv_nsec)/1e9;
+  double run_seconds = (end.tv_sec-decoded.tv_sec) + (end.tv_nsec-decoded.tv_nsec)/1e9;
+  double instance_seconds = 0;
+
+  printf("Decoded %llu memory accesses in %f seconds\n", access_count, decode_seconds);
+  printf("%-32s %10s %10s %10s %10s %10s %10s %10s %9s %9s %8s\n", "config", "L2 access", "L2 miss", "pf L2", "pf LLC",
+	 "redundant", "useful", "useless", "accuracy", "coverage", "seconds");
+  for(i=0; i<instance_count; i++)
+    {
+      instance_t *in = instances[i];
+      if(in->failed)
+	{
+	  printf("%-32s failed\n", in->name);
+	  continue;
+	}
+
+      unsigned long long int useful = in->useful_l2 + in->useful_llc;
+      unsigned long long int issued = in->prefetches_l2 + in->prefetches_llc;
+      // accuracy counts LLC prefetches that a later demand miss used,
+      // and coverage is the fraction of L2 misses that prefetches into the L2 removed
+      double accuracy = issued ? (double)useful / issued : 0;
+      double coverage = (in->l2_misses + in->useful_l2) ? (double)in->useful_l2 / (in->l2_misses + in->useful_l2) : 0;
+
+      printf("%-32s %10llu %10llu %10llu %10llu %10llu %10llu %10llu %9.4f %9.4f %8.3f\n", in->name, in->l2_accesses, in->l2_misses,
+	     in->prefetches_l2, in->prefetches_llc, in->prefetches_redundant, useful, in->useless_evicted, accuracy, coverage, in->seconds);
+      if(in->fills_unreported > 0)
+	{
+	  printf("%-32s warning: %llu prefetch fills beyond %d per access were not passed to l2_cache_fill()\n",
+		 in->name, in->fills_unreported, PENDING_FILL_COUNT);
+	}
+      instance_seconds += in->seconds;
+    }
+  printf("Ran %d configurations on %d threads in %f seconds, %f seconds of work, %.2fx parallel speedup\n",
+	 instance_count, thread_count, run_seconds, instance_seconds, run_seconds > 0 ? instance_seconds / run_seconds : 0);
+
+  return 0;
+}
@@ -11,19 +11,29 @@
   regions of virtual address space to make prefetching decisions, but this 
   version works only on smaller 4 KB physical pages.
 
+  Pages are found through the hashed page tracker in page_tracker.h, which
+  also takes care of page replacement.
+
+  Prefetches are placed into the L2 or LLC, or dropped, by the bandwidth
+  estimator in bandwidth_estimator.h.  A stride seen three times in a row is
+  given more confidence than one seen twice.
+
  */
 
 #include <stdio.h>
 #include "../inc/prefetcher.h"
 
-#define AMPM_PAGE_COUNT 64
+#ifndef AMPM_PAGE_COUNT
+#define AMPM_PAGE_COUNT 256
+#endif
+#define PAGE_TRACKER_ENTRIES AMPM_PAGE_COUNT
+#include "page_tracker.h"
+#include "bandwidth_estimator.h"
+
 #define PREFETCH_DEGREE 2
 
 typedef struct ampm_page
 {
-  // page address
-  unsigned long long int page;
-
   // The access map itself.
   // Each element is set when the corresponding cache line is accessed.
   // The whole structure is analyzed to make prefetching decisions.
@@ -33,11 +43,9 @@ typedef struct ampm_page
   // This map represents cache lines in this page that have already been prefetched.
   // We will only prefetch lines that haven't already been either demand accessed or prefetched.
   int pf_map[64];
-
-  // used for page replacement
-  unsigned long long int lru;
 } ampm_page_t;
 
+// indexed by the slot returned from page_tracker_lookup()
 ampm_page_t ampm_pages[AMPM_PAGE_COUNT];
 
 void l2_prefetcher_initialize(int cpu_num)
@@ -49,9 +57,6 @@ void l2_prefetcher_initialize(int cpu_num)
   int i;
   for(i=0; i<AMPM_PAGE_COUNT; i++)
     {
-      ampm_pages[i].page = 0;
-      ampm_pages[i].lru = 0;
-
       int j;
       for(j=0; j<64; j++)
 	{
@@ -59,6 +64,9 @@ void l2_prefetcher_initialize(int cpu_num)
 	  ampm_pages[i].pf_map[j] = 0;
 	}
     }
+
+  page_tracker_initialize();
+  bandwidth_estimator_initialize();
 }
 
 void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
@@ -70,38 +78,16 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   unsigned long long int page = cl_address>>6;
   unsigned long long int page_offset = cl_address&63;
 
+  bandwidth_estimator_operate(addr, cache_hit);
+
   // check to see if we have a page hit
-  int page_index = -1;
-  int i;
-  for(i=0; i<AMPM_PAGE_COUNT; i++)
-    {
-      if(ampm_pages[i].page == page)
-	{
-	  page_index = i;
-	  break;
-	}
-    }
+  int page_hit = 0;
+  int page_index = page_tracker_lookup(page, &page_hit);
 
-  if(page_index == -1)
+  int i;
+  if(!page_hit)
     {
-      // the page was not found, so we must replace an old page with this new page
-
-      // find the oldest page
-      int lru_index = 0;
-      unsigned long long int lru_cycle = ampm_pages[lru_index].lru;
-      int i;
-      for(i=0; i<AMPM_PAGE_COUNT; i++)
-	{
-	  if(ampm_pages[i].lru < lru_cycle)
-	    {
-	      lru_index = i;
-	      lru_cycle = ampm_pages[lru_index].lru;
-	    }
-	}
-      page_index = lru_index;
-
-      // reset the oldest page
-      ampm_pages[page_index].page = page;
+      // the page was not found, so reset the old page the page tracker chose to replace
       for(i=0; i<64; i++)
 	{
 	  ampm_pages[page_index].access_map[i] = 0;
@@ -109,9 +95,6 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 	}
     }
 
-  // update LRU
-  ampm_pages[page_index].lru = get_current_cycle(0);
-
   // mark the access map
   ampm_pages[page_index].access_map[page_offset] = 1;
 
@@ -156,14 +139,17 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 
 	  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-	  // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) < 8)
+	  // a stride repeated three times is a safer bet
+	  int check_index3 = page_offset - 3*i;
+	  int confidence = BW_CONFIDENCE_MEDIUM;
+	  if((check_index3 >= 0) && (ampm_pages[page_index].access_map[check_index3]==1))
 	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
+	      confidence = BW_CONFIDENCE_HIGH;
 	    }
-	  else
+	  if(!bandwidth_prefetch_line(addr, pf_address, confidence, 8))
 	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);	      
+	      // dropped while memory is saturated, so leave it unmarked to try again later
+	      continue;
 	    }
 
 	  // mark the prefetched line so we don't prefetch it again
@@ -213,14 +199,17 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 
 	  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-	  // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) < 12)
+	  // a stride repeated three times is a safer bet
+	  int check_index3 = page_offset + 3*i;
+	  int confidence = BW_CONFIDENCE_MEDIUM;
+	  if((check_index3 <= 63) && (ampm_pages[page_index].access_map[check_index3]==1))
 	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
+	      confidence = BW_CONFIDENCE_HIGH;
 	    }
-	  else
+	  if(!bandwidth_prefetch_line(addr, pf_address, confidence, 12))
 	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);	      
+	      // dropped while memory is saturated, so leave it unmarked to try again later
+	      continue;
 	    }
 
 	  // mark the prefetched line so we don't prefetch it again
@@ -234,6 +223,8 @@ void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, i
 {
   // uncomment this line to see the information available to you when there is a cache fill event
   //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  bandwidth_estimator_fill(addr, set, way, prefetch);
 }
 
 void l2_prefetcher_heartbeat_stats(int cpu_num)
@@ -249,4 +240,6 @@ void l2_prefetcher_warmup_stats(int cpu_num)
 void l2_prefetcher_final_stats(int cpu_num)
 {
   printf("Prefetcher final stats\n");
+  page_tracker_print_stats();
+  bandwidth_estimator_print_stats();
 }
@@ -0,0 +1,465 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a DRAM bandwidth estimator, and a fill placement
+  policy built on it.  Instead of choosing between FILL_L2 and FILL_LLC with
+  a fixed L2 MSHR cutoff, prefetchers call bandwidth_prefetch_line() with a
+  confidence for each prefetch, and the policy decides whether to fill it
+  into the L2, fill it into the LLC, or drop it.
+
+  The estimator only uses what the prefetcher hooks already see:
+
+  - Memory traffic: lines filled into the L2 (every l2_cache_fill() call),
+    plus prefetches issued into the LLC, counted over windows of
+    BW_WINDOW_CYCLES.  Each line occupies the DRAM data bus for
+    BW_LINE_CYCLES, or 4x that with knob_low_bandwidth, so the traffic in a
+    window gives the fraction of peak bandwidth in use.  A prefetch of a
+    line already in the L2, or of one prefetched shortly before, as
+    engines with a prefetch degree above 1 do all the time, costs no
+    traffic, and isn't counted.
+  - Miss rate: demand misses and prefetches per 1000 cycles, counted when
+    they are issued rather than when they fill.  Converted into bus cycles
+    the same way, this is the traffic being asked of memory, which runs
+    ahead of the fills while requests are queueing.
+  - Fill latency: the cycles from a demand miss or prefetch to the
+    l2_cache_fill() of that line, tracked in a small direct-mapped table.
+    Latency rising well above the lowest latency seen means requests are
+    queueing in the memory system.
+  - L2 read queue occupancy, sampled on every access.
+
+  Traffic, latency and read queue occupancy are combined into a single
+  pressure estimate between 0 and 1.  Latency only raises the estimate
+  once traffic is already high, because fills that hit in the LLC also
+  return quickly, and make the lowest latency seen a poor estimate of
+  unloaded DRAM latency.  The traffic requested can only raise the
+  estimate to saturated, since it runs ahead of the fills, but it isn't
+  bandwidth in use yet.
+
+  Medium and high-confidence prefetches are placed with the engine's own
+  MSHR cutoff, as before, and low-confidence prefetches always go to the
+  LLC.  Once memory is busy, medium-confidence prefetches also go to the
+  LLC.  Once it is saturated, high-confidence prefetches only go to the
+  LLC, where they don't hold an L2 MSHR that a demand miss needs, and all
+  others are dropped, so that prefetches stop competing with demand misses.
+
+  Memory only counts as saturated while prefetches are also inaccurate.
+  The estimator keeps a bit for each L2 way, set while the line there was
+  prefetched and hasn't been used, to measure the fraction of prefetched
+  lines used before they are evicted, counting a prefetch that a demand
+  miss caught up with while it was in flight as used.  Accurate prefetches fetch lines
+  that demand misses would fetch anyway, so holding them back doesn't free
+  any bandwidth, and only makes those misses wait longer.  Windows in
+  which no prefetch reached the L2 move the accuracy back towards 1, so a
+  saturated estimator lets prefetches into the L2 again to re-measure it.
+
+ */
+
+#ifndef BANDWIDTH_ESTIMATOR_H
+#define BANDWIDTH_ESTIMATOR_H
+
+#include <stdio.h>
+#include "../inc/prefetcher.h"
+
+// prefetch confidence levels passed to bandwidth_prefetch_line()
+#define BW_CONFIDENCE_LOW 1
+#define BW_CONFIDENCE_MEDIUM 2
+#define BW_CONFIDENCE_HIGH 3
+
+#define BW_WINDOW_CYCLES 1024
+
+// DRAM data bus cycles per 64 B line at the default 12.8 GB/s
+#define BW_LINE_CYCLES 16
+
+// direct-mapped table of outstanding requests, for measuring fill latency
+#define BW_LATENCY_ENTRIES 128
+
+// direct-mapped table of recently prefetched lines, so that re-issued prefetches aren't counted as traffic
+#define BW_RECENT_ENTRIES 256
+
+// pressure thresholds: above BUSY medium-confidence prefetches only fill the LLC,
+// and above SATURATED high-confidence prefetches only fill the LLC, and the rest are dropped
+#define BW_PRESSURE_BUSY 0.5
+#define BW_PRESSURE_SATURATED 0.85
+
+// once memory is saturated, prefetches are only held back while fewer than this fraction of them are used
+#ifndef BW_ACCURACY_WASTEFUL
+#define BW_ACCURACY_WASTEFUL 0.5
+#endif
+
+typedef struct bw_request
+{
+  // low 32 bits of the cache line address, 0 if the entry is free
+  unsigned int line;
+  // low 32 bits of the cycle the request was issued
+  unsigned int cycle;
+  // 1 once a demand miss has asked for the line
+  int demanded;
+} bw_request_t;
+
+bw_request_t bw_requests[BW_LATENCY_ENTRIES];
+
+// low 32 bits of the line of the last prefetch in each entry, 0 if empty
+unsigned int bw_recent_prefetches[BW_RECENT_ENTRIES];
+
+// one bit per L2 way, set while the line there was prefetched and hasn't been used yet
+unsigned char bw_unused_prefetches[L2_SET_COUNT];
+
+// current window
+unsigned long long int bw_window_start;
+unsigned int bw_window_lines;
+unsigned int bw_window_misses;
+unsigned int bw_window_prefetches;
+unsigned int bw_window_useful;
+unsigned int bw_window_useless;
+unsigned long long int bw_window_latency_sum;
+unsigned int bw_window_latency_count;
+
+// smoothed estimates, updated at the end of each window
+double bw_utilization;
+double bw_miss_rate;
+double bw_prefetch_rate;
+double bw_requested;
+double bw_accuracy;
+int bw_saturated;
+double bw_latency;
+double bw_latency_floor;
+double bw_read_queue;
+double bw_pressure;
+
+unsigned long long int bw_fill_l2;
+unsigned long long int bw_fill_llc;
+unsigned long long int bw_dropped;
+unsigned long long int bw_repeated;
+unsigned long long int bw_rejected;
+unsigned long long int bw_windows;
+unsigned long long int bw_saturated_windows;
+
+static void bandwidth_estimator_initialize()
+{
+  int i;
+  for(i=0; i<BW_LATENCY_ENTRIES; i++)
+    {
+      bw_requests[i].line = 0;
+      bw_requests[i].cycle = 0;
+      bw_requests[i].demanded = 0;
+    }
+  for(i=0; i<BW_RECENT_ENTRIES; i++)
+    {
+      bw_recent_prefetches[i] = 0;
+    }
+
+  bw_window_start = 0;
+  bw_window_lines = 0;
+  bw_window_misses = 0;
+  bw_window_prefetches = 0;
+  bw_window_useful = 0;
+  bw_window_useless = 0;
+  bw_window_latency_sum = 0;
+  bw_window_latency_count = 0;
+
+  for(i=0; i<L2_SET_COUNT; i++)
+    {
+      bw_unused_prefetches[i] = 0;
+    }
+
+  bw_utilization = 0;
+  bw_miss_rate = 0;
+  bw_prefetch_rate = 0;
+  bw_requested = 0;
+  // prefetches are assumed useful until they are seen to be evicted unused
+  bw_accuracy = 1;
+  bw_saturated = 0;
+  bw_latency = 0;
+  bw_latency_floor = 0;
+  bw_read_queue = 0;
+  bw_pressure = 0;
+
+  bw_fill_l2 = 0;
+  bw_fill_llc = 0;
+  bw_dropped = 0;
+  bw_repeated = 0;
+  bw_rejected = 0;
+  bw_windows = 0;
+  bw_saturated_windows = 0;
+}
+
+static void bw_track_request(unsigned long long int addr, unsigned long long int cycle, int demand)
+{
+  unsigned long long int line = addr>>6;
+  bw_request_t *request = &bw_requests[line % BW_LATENCY_ENTRIES];
+  if(request->line == (unsigned int)line)
+    {
+      // a demand miss merging with a prefetch still in flight, which makes that prefetch useful
+      request->demanded |= demand;
+      return;
+    }
+  request->line = line;
+  request->cycle = cycle;
+  request->demanded = demand;
+}
+
+// closes out any windows that have ended, and updates the smoothed estimates
+static void bw_update_window(unsigned long long int cycle)
+{
+  if(cycle < bw_window_start + BW_WINDOW_CYCLES)
+    {
+      return;
+    }
+
+  double elapsed = cycle - bw_window_start;
+  int line_cycles = knob_low_bandwidth ? 4*BW_LINE_CYCLES : BW_LINE_CYCLES;
+  double utilization = (bw_window_lines * line_cycles) / elapsed;
+  if(utilization > 1)
+    {
+      utilization = 1;
+    }
+  double miss_rate = bw_window_misses * 1000.0 / elapsed;
+  double prefetch_rate = bw_window_prefetches * 1000.0 / elapsed;
+
+  // exponentially weighted, giving the newest window a weight of 1/4
+  bw_utilization = 0.75*bw_utilization + 0.25*utilization;
+  bw_miss_rate = 0.75*bw_miss_rate + 0.25*miss_rate;
+  bw_prefetch_rate = 0.75*bw_prefetch_rate + 0.25*prefetch_rate;
+
+  // the fraction of peak bandwidth that the misses and prefetches issued are asking for
+  bw_requested = (bw_miss_rate + bw_prefetch_rate) * line_cycles / 1000;
+  if(bw_requested > 1)
+    {
+      bw_requested = 1;
+    }
+
+  if(bw_window_latency_count > 0)
+    {
+      double latency = (double)bw_window_latency_sum / bw_window_latency_count;
+      bw_latency = (bw_latency == 0) ? latency : 0.75*bw_latency + 0.25*latency;
+
+      // the floor follows drops in latency immediately, and rises only slowly,
+      // so that it approximates the unloaded latency
+      if((bw_latency_floor == 0) || (latency < bw_latency_floor))
+	{
+	  bw_latency_floor = latency;
+	}
+      else
+	{
+	  bw_latency_floor *= 1.001;
+	}
+    }
+
+  // latency at or below the floor means no queueing, and 3x the floor means saturated
+  double queueing = 0;
+  if(bw_latency_floor > 0)
+    {
+      queueing = (bw_latency/bw_latency_floor - 1) / 2;
+      if(queueing < 0)
+	{
+	  queueing = 0;
+	}
+      if(queueing > 1)
+	{
+	  queueing = 1;
+	}
+    }
+
+  // fills that hit in the LLC pull the latency floor well below DRAM latency,
+  // so queueing alone isn't trusted, and only adds to pressure once traffic is high too
+  bw_pressure = bw_utilization;
+  if(bw_read_queue > bw_pressure)
+    {
+      bw_pressure = bw_read_queue;
+    }
+  if((bw_utilization >= BW_PRESSURE_BUSY) && (queueing > bw_pressure))
+    {
+      bw_pressure = queueing;
+    }
+
+  if(bw_window_useful + bw_window_useless > 0)
+    {
+      double accuracy = (double)bw_window_useful / (bw_window_useful + bw_window_useless);
+      bw_accuracy = 0.75*bw_accuracy + 0.25*accuracy;
+    }
+  else
+    {
+      // nothing reached the L2 to be measured, most likely because saturation is holding
+      // prefetches back, so drift back towards accurate and let some through again
+      bw_accuracy = 0.75*bw_accuracy + 0.25;
+    }
+
+  // requests queue up before their fills show it, so the traffic requested warns of saturation
+  // before the traffic filled does, but only once it is also being filled is memory busy
+  double saturation = (bw_requested > bw_pressure) ? bw_requested : bw_pressure;
+
+  // accurate prefetches fetch lines that demand misses would fetch anyway, so holding them back
+  // while memory is saturated only delays those misses, and is only worth it for wasteful ones
+  bw_saturated = (saturation >= BW_PRESSURE_SATURATED) && (bw_accuracy < BW_ACCURACY_WASTEFUL);
+
+  bw_windows++;
+  if(bw_saturated)
+    {
+      bw_saturated_windows++;
+    }
+
+  bw_window_start = cycle;
+  bw_window_lines = 0;
+  bw_window_misses = 0;
+  bw_window_prefetches = 0;
+  bw_window_useful = 0;
+  bw_window_useless = 0;
+  bw_window_latency_sum = 0;
+  bw_window_latency_count = 0;
+}
+
+// call at the start of l2_prefetcher_operate()
+static void bandwidth_estimator_operate(unsigned long long int addr, int cache_hit)
+{
+  unsigned long long int cycle = get_current_cycle(0);
+  bw_update_window(cycle);
+
+  bw_read_queue = 0.99*bw_read_queue + 0.01*((double)get_l2_read_queue_occupancy(0) / L2_READ_QUEUE_SIZE);
+
+  if(!cache_hit)
+    {
+      bw_window_misses++;
+      bw_track_request(addr, cycle, 1);
+    }
+  else
+    {
+      int set = l2_get_set(addr);
+      int way = l2_get_way(0, addr, set);
+      if((way >= 0) && (bw_unused_prefetches[set] & (1<<way)))
+	{
+	  bw_window_useful++;
+	  bw_unused_prefetches[set] &= ~(1<<way);
+	}
+    }
+}
+
+// call from l2_cache_fill(), with its arguments
+static void bandwidth_estimator_fill(unsigned long long int addr, int set, int way, int prefetch)
+{
+  unsigned long long int cycle = get_current_cycle(0);
+  bw_update_window(cycle);
+
+  bw_window_lines++;
+
+  int demanded = 0;
+  unsigned long long int line = addr>>6;
+  bw_request_t *request = &bw_requests[line % BW_LATENCY_ENTRIES];
+  if((request->line != 0) && (request->line == (unsigned int)line))
+    {
+      bw_window_latency_sum += (unsigned int)cycle - request->cycle;
+      bw_window_latency_count++;
+      demanded = request->demanded;
+      request->line = 0;
+    }
+
+  // the line being replaced was a prefetch that was never used
+  if(bw_unused_prefetches[set] & (1<<way))
+    {
+      bw_window_useless++;
+    }
+  if(prefetch && demanded)
+    {
+      // a late prefetch, already used by the demand miss that waited for it
+      bw_window_useful++;
+      bw_unused_prefetches[set] &= ~(1<<way);
+    }
+  else if(prefetch)
+    {
+      bw_unused_prefetches[set] |= (1<<way);
+    }
+  else
+    {
+      bw_unused_prefetches[set] &= ~(1<<way);
+    }
+}
+
+// Decides where a prefetch of the given confidence should go: FILL_L2, FILL_LLC, or 0 to drop it.
+// With low memory pressure, prefetches fill the L2 while fewer than mshr_limit L2 MSHRs are occupied.
+static int bandwidth_fill_level(int confidence, int mshr_limit)
+{
+  int mshr_free = (get_l2_mshr_occupancy(0) < mshr_limit);
+
+  if(bw_saturated)
+    {
+      // only prefetches that are very likely to be used are worth any bandwidth,
+      // and they stay out of the L2 MSHRs
+      return (confidence >= BW_CONFIDENCE_HIGH) ? FILL_LLC : 0;
+    }
+
+  if(confidence < BW_CONFIDENCE_MEDIUM)
+    {
+      // low-confidence prefetches never take an L2 MSHR that a demand miss might need
+      return FILL_LLC;
+    }
+
+  if((confidence < BW_CONFIDENCE_HIGH) && (bw_pressure >= BW_PRESSURE_BUSY))
+    {
+      // medium-confidence prefetches stay out of the L2 MSHRs while memory is busy
+      return FILL_LLC;
+    }
+
+  return mshr_free ? FILL_L2 : FILL_LLC;
+}
+
+// Issues a prefetch at the level chosen by bandwidth_fill_level().
+// Returns 1 if the prefetch was issued, like l2_prefetch_line(), and 0 if it was dropped or failed.
+static int bandwidth_prefetch_line(unsigned long long int base_addr, unsigned long long int pf_addr, int confidence, int mshr_limit)
+{
+  int fill_level = bandwidth_fill_level(confidence, mshr_limit);
+  if(fill_level == 0)
+    {
+      bw_dropped++;
+      return 0;
+    }
+
+  if(!l2_prefetch_line(0, base_addr, pf_addr, fill_level))
+    {
+      bw_rejected++;
+      return 0;
+    }
+
+  if(fill_level == FILL_L2)
+    {
+      bw_fill_l2++;
+    }
+  else
+    {
+      bw_fill_llc++;
+    }
+
+  // a line that was just prefetched, or is already in the L2, costs no more memory traffic
+  unsigned long long int line = pf_addr>>6;
+  unsigned int *recent = &bw_recent_prefetches[line % BW_RECENT_ENTRIES];
+  if((*recent == (unsigned int)line) || (l2_get_way(0, pf_addr, l2_get_set(pf_addr)) >= 0))
+    {
+      bw_repeated++;
+      return 1;
+    }
+  *recent = line;
+
+  bw_window_prefetches++;
+  if(fill_level == FILL_L2)
+    {
+      bw_track_request(pf_addr, get_current_cycle(0), 0);
+    }
+  else
+    {
+      // LLC fills never reach l2_cache_fill(), so count their traffic here
+      bw_window_lines++;
+    }
+  return 1;
+}
+
+static void bandwidth_estimator_print_stats()
+{
+  printf("Bandwidth estimator: utilization %f requested %f (misses %f prefetches %f /kcycle) latency %f (floor %f) read queue %f pressure %f\n",
+	 bw_utilization, bw_requested, bw_miss_rate, bw_prefetch_rate, bw_latency, bw_latency_floor, bw_read_queue, bw_pressure);
+  printf("Bandwidth estimator: prefetch accuracy %f saturated windows %llu of %llu\n", bw_accuracy, bw_saturated_windows, bw_windows);
+  printf("Bandwidth placement: L2 %llu LLC %llu dropped %llu rejected %llu (repeats not counted as traffic %llu)\n",
+	 bw_fill_l2, bw_fill_llc, bw_dropped, bw_rejected, bw_repeated);
+}
+
+#endif
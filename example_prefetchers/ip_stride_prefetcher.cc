@@ -9,12 +9,15 @@
   The prefetcher detects stride patterns coming from the same IP, and then 
   prefetches additional cache lines.
 
-  Prefetches are issued into the L2 or LLC depending on L2 MSHR occupancy.
+  Prefetches are placed into the L2 or LLC, or dropped, by the bandwidth
+  estimator in bandwidth_estimator.h.  Prefetches further ahead of the
+  demand stream are given less confidence.
 
  */
 
 #include <stdio.h>
 #include "../inc/prefetcher.h"
+#include "bandwidth_estimator.h"
 
 #define IP_TRACKER_COUNT 1024
 #define PREFETCH_DEGREE 3
@@ -49,6 +52,8 @@ void l2_prefetcher_initialize(int cpu_num)
       trackers[i].last_stride = 0;
       trackers[i].lru_cycle = 0;
     }
+
+  bandwidth_estimator_initialize();
 }
 
 void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
@@ -56,6 +61,8 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   // uncomment this line to see all the information available to make prefetch decisions
   //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
 
+  bandwidth_estimator_operate(addr, cache_hit);
+
   // check for a tracker hit
   int tracker_index = -1;
 
@@ -133,16 +140,13 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 	      break;
 	    }
 
-	  // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) < 8)
+	  // the first prefetch is the most likely to be used, and each one after it less so
+	  int confidence = BW_CONFIDENCE_HIGH - i;
+	  if(confidence < BW_CONFIDENCE_LOW)
 	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
+	      confidence = BW_CONFIDENCE_LOW;
 	    }
-	  else
-	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);
-	    }
-	  
+	  bandwidth_prefetch_line(addr, pf_address, confidence, 8);
 	}
     }
 
@@ -154,6 +158,8 @@ void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, i
 {
   // uncomment this line to see the information available to you when there is a cache fill event
   //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  bandwidth_estimator_fill(addr, set, way, prefetch);
 }
 
 void l2_prefetcher_heartbeat_stats(int cpu_num)
@@ -169,4 +175,5 @@ void l2_prefetcher_warmup_stats(int cpu_num)
 void l2_prefetcher_final_stats(int cpu_num)
 {
   printf("Prefetcher final stats\n");
+  bandwidth_estimator_print_stats();
 }
@@ -0,0 +1,221 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a hashed, set-associative index for tracking 4 KB pages.
+  It replaces the linear page searches in the stream and AMPM prefetchers, so
+  that the number of tracked pages can grow into the thousands while lookups
+  stay constant-time.
+
+  The index only maps a page number to a slot number in the range
+  [0, PAGE_TRACKER_ENTRIES).  The including prefetcher keeps its own per-page
+  state in an array of PAGE_TRACKER_ENTRIES elements, indexed by that slot.
+
+  Each way stores a 16-bit compressed tag instead of the full page number.
+  Two pages can alias to the same set and tag, in which case they share one
+  slot's training state.  This is harmless for a prefetcher, because
+  prefetch addresses are always built from the current demand address.
+
+  Replacement within a set uses CLOCK: every way has a reference bit which is
+  set on each hit, and a per-set hand sweeps the ways, clearing reference bits
+  until it finds one that is already clear.
+
+  Define PAGE_TRACKER_ENTRIES (a power of two, and a multiple of
+  PAGE_TRACKER_WAYS) before including this file to size the table.
+
+  Building with -DPAGE_TRACKER_PROFILE records the pages looked up during
+  the simulation.  At the end, the recorded sequence is replayed into an
+  empty table PAGE_TRACKER_PROFILE_REPEAT times, and the cost per lookup is
+  taken from the time for the whole replay, since timing each lookup on its
+  own would mostly measure the clock.
+
+ */
+
+#ifndef PAGE_TRACKER_H
+#define PAGE_TRACKER_H
+
+#include <stdio.h>
+
+#ifndef PAGE_TRACKER_ENTRIES
+#define PAGE_TRACKER_ENTRIES 1024
+#endif
+
+#ifndef PAGE_TRACKER_WAYS
+#define PAGE_TRACKER_WAYS 8
+#endif
+
+#define PAGE_TRACKER_SETS (PAGE_TRACKER_ENTRIES/PAGE_TRACKER_WAYS)
+
+#if PAGE_TRACKER_SETS < 1
+#error "PAGE_TRACKER_ENTRIES must be at least PAGE_TRACKER_WAYS"
+#endif
+
+#if (PAGE_TRACKER_SETS & (PAGE_TRACKER_SETS-1)) != 0
+#error "PAGE_TRACKER_ENTRIES/PAGE_TRACKER_WAYS must be a power of two"
+#endif
+
+#ifdef PAGE_TRACKER_PROFILE
+#include <time.h>
+#define PAGE_TRACKER_PROFILE_PAGES (1<<20)
+#define PAGE_TRACKER_PROFILE_REPEAT 20
+#endif
+
+// compressed page tags, 0 marks an invalid way
+unsigned short page_tracker_tags[PAGE_TRACKER_ENTRIES];
+// CLOCK reference bits, one per way
+unsigned char page_tracker_ref[PAGE_TRACKER_ENTRIES];
+// CLOCK hand, one per set
+unsigned char page_tracker_hand[PAGE_TRACKER_SETS];
+
+unsigned long long int page_tracker_lookups;
+unsigned long long int page_tracker_hits;
+unsigned long long int page_tracker_evictions;
+#ifdef PAGE_TRACKER_PROFILE
+// the pages looked up so far, replayed by page_tracker_print_stats()
+unsigned long long int page_tracker_profile_pages[PAGE_TRACKER_PROFILE_PAGES];
+unsigned int page_tracker_profile_count;
+int page_tracker_profile_replaying;
+#endif
+
+static void page_tracker_initialize()
+{
+  int i;
+  for(i=0; i<PAGE_TRACKER_ENTRIES; i++)
+    {
+      page_tracker_tags[i] = 0;
+      page_tracker_ref[i] = 0;
+    }
+  for(i=0; i<PAGE_TRACKER_SETS; i++)
+    {
+      page_tracker_hand[i] = 0;
+    }
+
+  page_tracker_lookups = 0;
+  page_tracker_hits = 0;
+  page_tracker_evictions = 0;
+}
+
+// Returns the slot tracking this page.  If the page was not already tracked,
+// a slot is allocated for it and *hit is set to 0, in which case the caller
+// must reset its per-page state for that slot.
+static int page_tracker_lookup(unsigned long long int page, int *hit)
+{
+#ifdef PAGE_TRACKER_PROFILE
+  if(!page_tracker_profile_replaying && (page_tracker_profile_count < PAGE_TRACKER_PROFILE_PAGES))
+    {
+      page_tracker_profile_pages[page_tracker_profile_count++] = page;
+    }
+#endif
+
+  // multiplicative hashing spreads neighboring pages across sets,
+  // and the top 16 bits of the hash become the compressed tag
+  unsigned long long int hash = page * 0x9E3779B97F4A7C15ULL;
+  int set = (hash >> 20) & (PAGE_TRACKER_SETS-1);
+  unsigned short tag = hash >> 48;
+  if(tag == 0)
+    {
+      tag = 1;
+    }
+
+  int base = set*PAGE_TRACKER_WAYS;
+  int slot = -1;
+  int invalid = -1;
+
+  page_tracker_lookups++;
+
+  int i;
+  for(i=0; i<PAGE_TRACKER_WAYS; i++)
+    {
+      if(page_tracker_tags[base+i] == tag)
+	{
+	  slot = base+i;
+	  break;
+	}
+      if((invalid == -1) && (page_tracker_tags[base+i] == 0))
+	{
+	  invalid = base+i;
+	}
+    }
+
+  if(slot != -1)
+    {
+      page_tracker_hits++;
+      *hit = 1;
+    }
+  else
+    {
+      *hit = 0;
+
+      if(invalid != -1)
+	{
+	  slot = invalid;
+	}
+      else
+	{
+	  // advance the CLOCK hand until we find a way that hasn't been referenced
+	  int hand = page_tracker_hand[set];
+	  while(page_tracker_ref[base+hand])
+	    {
+	      page_tracker_ref[base+hand] = 0;
+	      hand = (hand+1) % PAGE_TRACKER_WAYS;
+	    }
+	  slot = base+hand;
+	  page_tracker_hand[set] = (hand+1) % PAGE_TRACKER_WAYS;
+	  page_tracker_evictions++;
+	}
+
+      page_tracker_tags[slot] = tag;
+    }
+
+  page_tracker_ref[slot] = 1;
+
+  return slot;
+}
+
+static void page_tracker_print_stats()
+{
+  double hit_rate = 0;
+  if(page_tracker_lookups > 0)
+    {
+      hit_rate = (double)page_tracker_hits / page_tracker_lookups;
+    }
+
+  printf("Page tracker: %d entries (%d sets x %d ways), %lu bytes\n", PAGE_TRACKER_ENTRIES, PAGE_TRACKER_SETS, PAGE_TRACKER_WAYS,
+	 (unsigned long)(sizeof(page_tracker_tags)+sizeof(page_tracker_ref)+sizeof(page_tracker_hand)));
+  printf("Page tracker lookups: %llu hits: %llu hit rate: %f evictions: %llu\n", page_tracker_lookups, page_tracker_hits, hit_rate, page_tracker_evictions);
+#ifdef PAGE_TRACKER_PROFILE
+  if(page_tracker_profile_count == 0)
+    {
+      return;
+    }
+
+  // the table is no longer needed by the prefetcher, so replay the recorded lookups into it
+  page_tracker_profile_replaying = 1;
+  double ns = 0;
+  int repeat;
+  for(repeat=0; repeat<PAGE_TRACKER_PROFILE_REPEAT; repeat++)
+    {
+      page_tracker_initialize();
+
+      struct timespec start, end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      unsigned int i;
+      for(i=0; i<page_tracker_profile_count; i++)
+	{
+	  int hit;
+	  page_tracker_lookup(page_tracker_profile_pages[i], &hit);
+	}
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      ns += (end.tv_sec-start.tv_sec)*1e9 + (end.tv_nsec-start.tv_nsec);
+    }
+  page_tracker_profile_replaying = 0;
+
+  printf("Page tracker lookup cost: %f ns/call over %u lookups x %d\n",
+	 ns / ((double)page_tracker_profile_count * PAGE_TRACKER_PROFILE_REPEAT), page_tracker_profile_count,
+	 PAGE_TRACKER_PROFILE_REPEAT);
+#endif
+}
+
+#endif
@@ -8,22 +8,31 @@
   This file describes a streaming prefetcher. Prefetches are issued after
   a spatial locality is detected, and a stream direction can be determined.
 
-  Prefetches are issued into the L2 or LLC depending on L2 MSHR occupancy.
+  Prefetches are placed into the L2 or LLC, or dropped, by the bandwidth
+  estimator in bandwidth_estimator.h, depending on L2 MSHR occupancy,
+  estimated DRAM bandwidth headroom, and the detector's confidence.
+
+  Detectors are found through the hashed page tracker in page_tracker.h, so
+  STREAM_DETECTOR_COUNT can be raised into the thousands without slowing
+  down each access.
 
  */
 
 #include <stdio.h>
 #include "../inc/prefetcher.h"
 
-#define STREAM_DETECTOR_COUNT 64
+#ifndef STREAM_DETECTOR_COUNT
+#define STREAM_DETECTOR_COUNT 256
+#endif
+#define PAGE_TRACKER_ENTRIES STREAM_DETECTOR_COUNT
+#include "page_tracker.h"
+#include "bandwidth_estimator.h"
+
 #define STREAM_WINDOW 16
 #define PREFETCH_DEGREE 2
 
 typedef struct stream_detector
 {
-  // which 4 KB page this detector is monitoring
-  unsigned long long int page;
-  
   // + or - direction for the stream
   int direction;
 
@@ -34,8 +43,8 @@ typedef struct stream_detector
   int pf_index;
 } stream_detector_t;
 
+// indexed by the slot returned from page_tracker_lookup()
 stream_detector_t detectors[STREAM_DETECTOR_COUNT];
-int replacement_index;
 
 void l2_prefetcher_initialize(int cpu_num)
 {
@@ -46,13 +55,13 @@ void l2_prefetcher_initialize(int cpu_num)
   int i;
   for(i=0; i<STREAM_DETECTOR_COUNT; i++)
     {
-      detectors[i].page = 0;
       detectors[i].direction = 0;
       detectors[i].confidence = 0;
       detectors[i].pf_index = -1;
     }
 
-  replacement_index = 0;
+  page_tracker_initialize();
+  bandwidth_estimator_initialize();
 }
 
 void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
@@ -64,31 +73,16 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   unsigned long long int page = cl_address>>6;
   int page_offset = cl_address&63;
 
-  // check for a detector hit
-  int detector_index = -1;
+  bandwidth_estimator_operate(addr, cache_hit);
 
-  int i;
-  for(i=0; i<STREAM_DETECTOR_COUNT; i++)
-    {
-      if(detectors[i].page == page)
-	{
-	  detector_index = i;
-	  break;
-	}
-    }
+  // check for a detector hit
+  int detector_hit = 0;
+  int detector_index = page_tracker_lookup(page, &detector_hit);
 
-  if(detector_index == -1)
+  if(!detector_hit)
     {
-      // this is a new page that doesn't have a detector yet, so allocate one
-      detector_index = replacement_index;
-      replacement_index++;
-      if(replacement_index >= STREAM_DETECTOR_COUNT)
-	{
-	  replacement_index = 0;
-	}
-
-      // reset the oldest page
-      detectors[detector_index].page = page;
+      // this is a new page that doesn't have a detector yet,
+      // so reset the detector the page tracker chose to replace
       detectors[detector_index].direction = 0;
       detectors[detector_index].confidence = 0;
       detectors[detector_index].pf_index = page_offset;
@@ -151,16 +145,14 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 	  // perform prefetches
 	  unsigned long long int pf_address = (page<<12)+((detectors[detector_index].pf_index)<<6);
 	  
-	  // check MSHR occupancy to decide whether to prefetch into the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) > 8)
+	  // a stream that has been confirmed many times is a safe bet even when bandwidth is scarce,
+	  // otherwise prefetch into the L2 only while no more than 8 MSHRs are busy
+	  int confidence = (detectors[detector_index].confidence >= 4) ? BW_CONFIDENCE_HIGH : BW_CONFIDENCE_MEDIUM;
+	  if(!bandwidth_prefetch_line(addr, pf_address, confidence, 9))
 	    {
-	      // conservatively prefetch into the LLC, because MSHRs are scarce
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);
-	    }
-	  else
-	    {
-	      // MSHRs not too busy, so prefetch into L2
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
+	      // dropped while memory is saturated, so step back and prefetch this line again later
+	      detectors[detector_index].pf_index -= detectors[detector_index].direction;
+	      break;
 	    }
 	}
     }
@@ -170,6 +162,8 @@ void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, i
 {
   // uncomment this line to see the information available to you when there is a cache fill event
   //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  bandwidth_estimator_fill(addr, set, way, prefetch);
 }
 
 void l2_prefetcher_heartbeat_stats(int cpu_num)
@@ -185,4 +179,6 @@ void l2_prefetcher_warmup_stats(int cpu_num)
 void l2_prefetcher_final_stats(int cpu_num)
 {
   printf("Prefetcher final stats\n");
+  page_tracker_print_stats();
+  bandwidth_estimator_print_stats();
 }
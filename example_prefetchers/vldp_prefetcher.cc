@@ -0,0 +1,316 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a delta-correlating prefetcher, modeled after the
+  Variable Length Delta Prefetcher (VLDP).  Unlike the IP-based stride
+  prefetcher, which only fires when the same stride repeats, it learns
+  repeating sequences of different deltas, such as +1,+3,+1,+3.
+
+  Each tracked page keeps its last offset and a short history of the deltas
+  between its accesses, packed into a single integer.  Three Delta
+  Prediction Tables (DPTs) map the last 1, 2 and 3 deltas to the delta that
+  followed them.  A prediction is taken from the longest history that
+  matches, and is then appended to the history to look up the next one, so
+  that several prefetches can be chained ahead of the demand stream, up to
+  the edge of the 4 KB page.
+
+  The first access to a page has no deltas yet, so the Offset Prediction
+  Table (OPT) maps the first offset in a page to the delta that followed it.
+
+  Prefetches are placed into the L2 or LLC, or dropped, by the bandwidth
+  estimator in bandwidth_estimator.h, using the confidence of the DPT or
+  OPT entry that predicted them.
+
+ */
+
+#include <stdio.h>
+#include "../inc/prefetcher.h"
+
+#ifndef VLDP_PAGE_COUNT
+#define VLDP_PAGE_COUNT 256
+#endif
+#define PAGE_TRACKER_ENTRIES VLDP_PAGE_COUNT
+#include "page_tracker.h"
+#include "bandwidth_estimator.h"
+
+// number of DPTs, which is also the longest delta history that is tracked
+#define DPT_COUNT 3
+#define DPT_ENTRIES 64
+#define PREFETCH_DEGREE 4
+
+// deltas are stored as 7-bit two's complement, which covers -63 to +63 cache lines
+#define DELTA_BITS 7
+#define DELTA_MASK ((1<<DELTA_BITS)-1)
+
+// saturating 2-bit confidence counters, which line up with the BW_CONFIDENCE levels
+#define CONFIDENCE_MAX 3
+
+typedef struct delta_history
+{
+  // cache line index within the page of the last access
+  int last_offset;
+
+  // the most recent deltas, packed DELTA_BITS apart with the newest in the low bits
+  unsigned int deltas;
+
+  // how many valid deltas are in the history, up to DPT_COUNT
+  int delta_count;
+} delta_history_t;
+
+typedef struct delta_prediction
+{
+  // the packed delta history this entry was trained on, used as a tag
+  unsigned int key;
+
+  // the delta that followed that history
+  int delta;
+
+  // predictions are only used once this is nonzero
+  int confidence;
+} delta_prediction_t;
+
+// indexed by the slot returned from page_tracker_lookup()
+delta_history_t histories[VLDP_PAGE_COUNT];
+
+// dpt[i] is keyed by the last i+1 deltas
+delta_prediction_t dpt[DPT_COUNT][DPT_ENTRIES];
+
+// indexed by the first offset accessed in a page
+delta_prediction_t opt[64];
+
+unsigned long long int dpt_predictions[DPT_COUNT];
+unsigned long long int opt_predictions;
+
+unsigned int pack_delta(int delta)
+{
+  return ((unsigned int)delta) & DELTA_MASK;
+}
+
+// the last length deltas of a packed history
+unsigned int history_key(unsigned int deltas, int length)
+{
+  return deltas & ((1u<<(DELTA_BITS*length))-1);
+}
+
+int dpt_index(unsigned int key)
+{
+  return (key ^ (key>>6) ^ (key>>13)) % DPT_ENTRIES;
+}
+
+void train(delta_prediction_t *entry, unsigned int key, int delta)
+{
+  if(entry->key != key)
+    {
+      // a different history owns this entry, so take it over
+      entry->key = key;
+      entry->delta = delta;
+      entry->confidence = 1;
+    }
+  else if(entry->delta == delta)
+    {
+      if(entry->confidence < CONFIDENCE_MAX)
+	{
+	  entry->confidence++;
+	}
+    }
+  else
+    {
+      entry->confidence--;
+      if(entry->confidence <= 0)
+	{
+	  entry->delta = delta;
+	  entry->confidence = 1;
+	}
+    }
+}
+
+// Looks up the longest matching history in the DPTs.  Returns the predicted delta,
+// or 0 if no DPT has a confident prediction, and sets *confidence.
+int predict(unsigned int deltas, int delta_count, int *confidence)
+{
+  int length;
+  for(length=delta_count; length>=1; length--)
+    {
+      unsigned int key = history_key(deltas, length);
+      delta_prediction_t *entry = &dpt[length-1][dpt_index(key)];
+      if((entry->key == key) && (entry->confidence > 0))
+	{
+	  dpt_predictions[length-1]++;
+	  *confidence = entry->confidence;
+	  return entry->delta;
+	}
+    }
+
+  *confidence = 0;
+  return 0;
+}
+
+void issue_prefetch(unsigned long long int addr, unsigned long long int page, int pf_offset, int confidence)
+{
+  unsigned long long int pf_address = (page<<12)+(pf_offset<<6);
+  bandwidth_prefetch_line(addr, pf_address, confidence, 8);
+}
+
+void l2_prefetcher_initialize(int cpu_num)
+{
+  printf("VLDP Delta-Correlating Prefetcher\n");
+  // you can inspect these knob values from your code to see which configuration you're runnig in
+  printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
+
+  int i;
+  for(i=0; i<VLDP_PAGE_COUNT; i++)
+    {
+      histories[i].last_offset = 0;
+      histories[i].deltas = 0;
+      histories[i].delta_count = 0;
+    }
+
+  for(i=0; i<DPT_COUNT; i++)
+    {
+      int j;
+      for(j=0; j<DPT_ENTRIES; j++)
+	{
+	  dpt[i][j].key = 0;
+	  dpt[i][j].delta = 0;
+	  dpt[i][j].confidence = 0;
+	}
+      dpt_predictions[i] = 0;
+    }
+
+  for(i=0; i<64; i++)
+    {
+      opt[i].key = i;
+      opt[i].delta = 0;
+      opt[i].confidence = 0;
+    }
+  opt_predictions = 0;
+
+  page_tracker_initialize();
+  bandwidth_estimator_initialize();
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  // uncomment this line to see all the information available to make prefetch decisions
+  //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
+
+  unsigned long long int cl_address = addr>>6;
+  unsigned long long int page = cl_address>>6;
+  int page_offset = cl_address&63;
+
+  bandwidth_estimator_operate(addr, cache_hit);
+
+  int page_hit = 0;
+  int history_index = page_tracker_lookup(page, &page_hit);
+  delta_history_t *history = &histories[history_index];
+
+  if(!page_hit)
+    {
+      // first access to this page, so there are no deltas yet and only the OPT can predict
+      history->last_offset = page_offset;
+      history->deltas = 0;
+      history->delta_count = 0;
+
+      if(opt[page_offset].confidence > 0)
+	{
+	  int pf_offset = page_offset + opt[page_offset].delta;
+	  if((pf_offset >= 0) && (pf_offset <= 63))
+	    {
+	      opt_predictions++;
+	      issue_prefetch(addr, page, pf_offset, opt[page_offset].confidence);
+	    }
+	}
+      return;
+    }
+
+  int delta = page_offset - history->last_offset;
+  if(delta == 0)
+    {
+      // don't do anything if we saw the same cache line twice in a row
+      return;
+    }
+
+  // train the tables on what followed the history
+  if(history->delta_count == 0)
+    {
+      train(&opt[history->last_offset], history->last_offset, delta);
+    }
+  int length;
+  for(length=1; length<=history->delta_count; length++)
+    {
+      unsigned int key = history_key(history->deltas, length);
+      train(&dpt[length-1][dpt_index(key)], key, delta);
+    }
+
+  // shift the new delta into the history
+  history->deltas = history_key((history->deltas<<DELTA_BITS) | pack_delta(delta), DPT_COUNT);
+  if(history->delta_count < DPT_COUNT)
+    {
+      history->delta_count++;
+    }
+  history->last_offset = page_offset;
+
+  // chain predictions, feeding each predicted delta back into a speculative copy of the history
+  unsigned int spec_deltas = history->deltas;
+  int spec_count = history->delta_count;
+  int pf_offset = page_offset;
+  int i;
+  for(i=0; i<PREFETCH_DEGREE; i++)
+    {
+      int confidence = 0;
+      int pf_delta = predict(spec_deltas, spec_count, &confidence);
+      if(pf_delta == 0)
+	{
+	  break;
+	}
+
+      pf_offset += pf_delta;
+      if((pf_offset < 0) || (pf_offset > 63))
+	{
+	  // we've gone off the edge of a 4 KB page
+	  break;
+	}
+
+      issue_prefetch(addr, page, pf_offset, confidence);
+
+      spec_deltas = history_key((spec_deltas<<DELTA_BITS) | pack_delta(pf_delta), DPT_COUNT);
+      if(spec_count < DPT_COUNT)
+	{
+	  spec_count++;
+	}
+    }
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  // uncomment this line to see the information available to you when there is a cache fill event
+  //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  bandwidth_estimator_fill(addr, set, way, prefetch);
+}
+
+void l2_prefetcher_heartbeat_stats(int cpu_num)
+{
+  printf("Prefetcher heartbeat stats\n");
+}
+
+void l2_prefetcher_warmup_stats(int cpu_num)
+{
+  printf("Prefetcher warmup complete stats\n\n");
+}
+
+void l2_prefetcher_final_stats(int cpu_num)
+{
+  printf("Prefetcher final stats\n");
+  printf("OPT predictions: %llu\n", opt_predictions);
+  int i;
+  for(i=0; i<DPT_COUNT; i++)
+    {
+      printf("DPT%d predictions: %llu\n", i+1, dpt_predictions[i]);
+    }
+  page_tracker_print_stats();
+  bandwidth_estimator_print_stats();
+}
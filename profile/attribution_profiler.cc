@@ -0,0 +1,397 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes an attribution profiler, which shows which load IPs
+  and pages a prefetcher helps or hurts, instead of only its overall IPC.
+
+  It does NOT implement a prefetcher.  It is linked between any prefetcher
+  in example_prefetchers/ and lib/dpc2sim.a, with the linker's --wrap
+  option (see the dpc2prof-% rule in the Makefile), so that every call
+  between the simulator and the prefetcher passes through it.  The
+  prefetcher itself is unchanged.
+
+  Each prefetch the prefetcher issues into the L2 is tagged with the IP of
+  the l2_prefetcher_operate() call that triggered it.  The profiler keeps a
+  copy of the L2 tags, filled from l2_cache_fill(), so it can tell what
+  became of each prefetch:
+
+  - useful: a demand access hit the prefetched line
+  - late: a demand access missed on the line while the prefetch was still
+    in flight
+  - useless: the prefetched line was evicted without being used
+  - polluting: a prefetch fill evicted a line, and a demand access missed
+    on that line afterwards
+  - redundant: the line was already in the L2, or a demand miss was
+    already fetching it, so the prefetch never filled a line of its own
+
+  Every prefetch issued into the L2 ends up exactly one of useful, late,
+  useless or redundant, unless it is still in flight or unused at the end
+  of the simulation, or its tag was overwritten in the table of prefetches
+  in flight.  One that filled a line may also be polluting.  Accuracy is
+  useful prefetches over issued prefetches that weren't redundant.
+
+  Demand misses are counted against the IP that missed, and demand hits on
+  prefetched lines as covered for that IP, while prefetch outcomes are
+  counted against the triggering IP.  Every outcome is also counted against
+  the 4 KB page of the line.
+
+  There can be far more IPs and pages than are worth keeping counters for,
+  so both are counted in fixed-size space-saving tables, which keep the
+  PROFILE_TABLE_ENTRIES keys seen most often, along with a bound on how
+  much each key's counts may be under-reported.  At the end of the
+  simulation, the top PROFILE_TOP_K IPs and pages are printed by misses,
+  by coverage and by pollution.
+
+  Prefetches into the LLC are counted separately, but their outcomes are not
+  attributed, since the LLC contents aren't visible to a prefetcher.  Counts
+  are reset at the end of warmup, like the simulator's IPC.
+
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "../inc/prefetcher.h"
+
+#ifndef PROFILE_ENGINE
+#define PROFILE_ENGINE "unknown"
+#endif
+
+#define PROFILE_TABLE_ENTRIES 64
+#define PROFILE_TOP_K 10
+
+// direct-mapped tables of prefetches in flight, and of lines evicted by prefetch fills
+#define PROFILE_INFLIGHT_ENTRIES 256
+#define PROFILE_VICTIM_ENTRIES 1024
+
+enum profile_outcome
+{
+  PROFILE_MISS,
+  PROFILE_COVERED,
+  PROFILE_ISSUED,
+  PROFILE_REDUNDANT,
+  PROFILE_ISSUED_LLC,
+  PROFILE_USEFUL,
+  PROFILE_LATE,
+  PROFILE_USELESS,
+  PROFILE_POLLUTING,
+  PROFILE_OUTCOMES
+};
+
+const char *profile_outcome_names[PROFILE_OUTCOMES] = { "misses", "covered", "issued", "redundant", "issued LLC", "useful", "late", "useless", "polluting" };
+
+typedef struct heavy_hitter
+{
+  // the IP or page, valid only if count is nonzero
+  unsigned long long int key;
+
+  // events counted for this key, including up to error events for keys it replaced
+  unsigned long long int count;
+  unsigned long long int error;
+
+  unsigned long long int outcomes[PROFILE_OUTCOMES];
+} heavy_hitter_t;
+
+typedef struct profile_block
+{
+  // cache line address, 0 if invalid
+  unsigned long long int line;
+  // set while a prefetched line has not yet been used by a demand access
+  int prefetched;
+  unsigned long long int trigger_ip;
+} profile_block_t;
+
+typedef struct prefetch_tag
+{
+  // cache line address, 0 if the entry is free
+  unsigned long long int line;
+  unsigned long long int trigger_ip;
+  // set when a demand access missed on the line before it was filled
+  int late;
+} prefetch_tag_t;
+
+heavy_hitter_t ip_table[PROFILE_TABLE_ENTRIES];
+heavy_hitter_t page_table[PROFILE_TABLE_ENTRIES];
+unsigned long long int outcome_totals[PROFILE_OUTCOMES];
+
+profile_block_t l2_blocks[L2_SET_COUNT][L2_ASSOCIATIVITY];
+prefetch_tag_t inflight[PROFILE_INFLIGHT_ENTRIES];
+prefetch_tag_t victims[PROFILE_VICTIM_ENTRIES];
+
+// the IP of the l2_prefetcher_operate() call in progress, which triggers any prefetches it issues
+unsigned long long int current_ip;
+
+extern "C" {
+void __real_l2_prefetcher_initialize(int cpu_num);
+void __real_l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit);
+void __real_l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr);
+void __real_l2_prefetcher_warmup_stats(int cpu_num);
+void __real_l2_prefetcher_final_stats(int cpu_num);
+int __real_l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level);
+}
+
+// Counts one event for key.  A key that isn't in the table replaces the key with the fewest events,
+// and inherits its count, so that the table always holds the keys most likely to be most frequent.
+heavy_hitter_t *space_saving_update(heavy_hitter_t *table, unsigned long long int key)
+{
+  heavy_hitter_t *min = &table[0];
+  int i;
+  for(i=0; i<PROFILE_TABLE_ENTRIES; i++)
+    {
+      if((table[i].count != 0) && (table[i].key == key))
+	{
+	  table[i].count++;
+	  return &table[i];
+	}
+      if(table[i].count < min->count)
+	{
+	  min = &table[i];
+	}
+    }
+
+  min->key = key;
+  min->error = min->count;
+  min->count++;
+  memset(min->outcomes, 0, sizeof(min->outcomes));
+  return min;
+}
+
+void profile_record(unsigned long long int ip, unsigned long long int line, int outcome)
+{
+  space_saving_update(ip_table, ip)->outcomes[outcome]++;
+  space_saving_update(page_table, line>>6)->outcomes[outcome]++;
+  outcome_totals[outcome]++;
+}
+
+void profile_reset()
+{
+  memset(ip_table, 0, sizeof(ip_table));
+  memset(page_table, 0, sizeof(page_table));
+  memset(outcome_totals, 0, sizeof(outcome_totals));
+}
+
+profile_block_t *find_block(unsigned long long int line)
+{
+  profile_block_t *set = l2_blocks[l2_get_set(line<<6)];
+  int way;
+  for(way=0; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(set[way].line == line)
+	{
+	  return &set[way];
+	}
+    }
+  return NULL;
+}
+
+prefetch_tag_t *find_tag(prefetch_tag_t *table, int entries, unsigned long long int line)
+{
+  prefetch_tag_t *tag = &table[line % entries];
+  return (tag->line == line) ? tag : NULL;
+}
+
+extern "C" void __wrap_l2_prefetcher_initialize(int cpu_num)
+{
+  printf("Attribution profiler, profiling engine %s\n", PROFILE_ENGINE);
+
+  memset(l2_blocks, 0, sizeof(l2_blocks));
+  memset(inflight, 0, sizeof(inflight));
+  memset(victims, 0, sizeof(victims));
+  profile_reset();
+
+  __real_l2_prefetcher_initialize(cpu_num);
+}
+
+extern "C" void __wrap_l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  unsigned long long int line = addr>>6;
+
+  if(cache_hit)
+    {
+      profile_block_t *block = find_block(line);
+      if((block != NULL) && block->prefetched)
+	{
+	  profile_record(ip, line, PROFILE_COVERED);
+	  profile_record(block->trigger_ip, line, PROFILE_USEFUL);
+	  block->prefetched = 0;
+	}
+    }
+  else
+    {
+      profile_record(ip, line, PROFILE_MISS);
+
+      prefetch_tag_t *tag = find_tag(inflight, PROFILE_INFLIGHT_ENTRIES, line);
+      if((tag != NULL) && !tag->late)
+	{
+	  profile_record(tag->trigger_ip, line, PROFILE_LATE);
+	  tag->late = 1;
+	}
+
+      prefetch_tag_t *victim = find_tag(victims, PROFILE_VICTIM_ENTRIES, line);
+      if(victim != NULL)
+	{
+	  profile_record(victim->trigger_ip, line, PROFILE_POLLUTING);
+	  victim->line = 0;
+	}
+    }
+
+  current_ip = ip;
+  __real_l2_prefetcher_operate(cpu_num, addr, ip, cache_hit);
+}
+
+extern "C" int __wrap_l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  int issued = __real_l2_prefetch_line(cpu_num, base_addr, pf_addr, fill_level);
+  if(!issued)
+    {
+      return issued;
+    }
+
+  unsigned long long int line = pf_addr>>6;
+  if(fill_level != FILL_L2)
+    {
+      profile_record(current_ip, line, PROFILE_ISSUED_LLC);
+      return issued;
+    }
+
+  profile_record(current_ip, line, PROFILE_ISSUED);
+  if(find_block(line) != NULL)
+    {
+      profile_record(current_ip, line, PROFILE_REDUNDANT);
+      return issued;
+    }
+
+  prefetch_tag_t *tag = &inflight[line % PROFILE_INFLIGHT_ENTRIES];
+  tag->line = line;
+  tag->trigger_ip = current_ip;
+  tag->late = 0;
+  return issued;
+}
+
+extern "C" void __wrap_l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  unsigned long long int line = addr>>6;
+  profile_block_t *block = &l2_blocks[set][way];
+
+  prefetch_tag_t *tag = find_tag(inflight, PROFILE_INFLIGHT_ENTRIES, line);
+
+  if(block->line != 0)
+    {
+      if(block->prefetched)
+	{
+	  profile_record(block->trigger_ip, block->line, PROFILE_USELESS);
+	}
+      else if(prefetch && (tag != NULL))
+	{
+	  // remember the demand line this prefetch displaced, in case it's missed on again
+	  prefetch_tag_t *victim = &victims[block->line % PROFILE_VICTIM_ENTRIES];
+	  victim->line = block->line;
+	  victim->trigger_ip = tag->trigger_ip;
+	  victim->late = 0;
+	}
+    }
+
+  if((tag != NULL) && !prefetch && !tag->late)
+    {
+      // the prefetch merged with a demand miss that was issued before it
+      profile_record(tag->trigger_ip, line, PROFILE_REDUNDANT);
+    }
+
+  block->line = line;
+  // a late prefetch's line is used by the demand miss waiting on it, so it isn't counted again
+  block->prefetched = prefetch && (tag != NULL) && !tag->late;
+  block->trigger_ip = (tag != NULL) ? tag->trigger_ip : 0;
+  if(tag != NULL)
+    {
+      tag->line = 0;
+    }
+
+  __real_l2_cache_fill(cpu_num, addr, set, way, prefetch, evicted_addr);
+}
+
+extern "C" void __wrap_l2_prefetcher_warmup_stats(int cpu_num)
+{
+  __real_l2_prefetcher_warmup_stats(cpu_num);
+  profile_reset();
+}
+
+// prints the k entries of table with the highest value of the outcomes named by first and second
+void print_top(const char *title, heavy_hitter_t *table, int first, int second)
+{
+  int printed[PROFILE_TABLE_ENTRIES];
+  memset(printed, 0, sizeof(printed));
+
+  printf("Top %d %s:\n", PROFILE_TOP_K, title);
+  printf("  %-18s", "key");
+  int o;
+  for(o=0; o<PROFILE_OUTCOMES; o++)
+    {
+      printf(" %10s", profile_outcome_names[o]);
+    }
+  printf(" %9s %9s %9s\n", "coverage", "accuracy", "error");
+
+  int k;
+  for(k=0; k<PROFILE_TOP_K; k++)
+    {
+      int best = -1;
+      unsigned long long int best_value = 0;
+      int i;
+      for(i=0; i<PROFILE_TABLE_ENTRIES; i++)
+	{
+	  unsigned long long int value = table[i].outcomes[first] + ((second >= 0) ? table[i].outcomes[second] : 0);
+	  if(!printed[i] && (value > best_value))
+	    {
+	      best = i;
+	      best_value = value;
+	    }
+	}
+      if(best < 0)
+	{
+	  if(k == 0)
+	    {
+	      printf("  (none)\n");
+	    }
+	  break;
+	}
+      printed[best] = 1;
+
+      heavy_hitter_t *entry = &table[best];
+      unsigned long long int *outcomes = entry->outcomes;
+      double coverage = (outcomes[PROFILE_COVERED]+outcomes[PROFILE_MISS]) ?
+	(double)outcomes[PROFILE_COVERED] / (outcomes[PROFILE_COVERED]+outcomes[PROFILE_MISS]) : 0;
+      // issued and redundant may be under-reported by different amounts, so guard against more redundant than issued
+      double accuracy = (outcomes[PROFILE_ISSUED] > outcomes[PROFILE_REDUNDANT]) ?
+	(double)outcomes[PROFILE_USEFUL] / (outcomes[PROFILE_ISSUED]-outcomes[PROFILE_REDUNDANT]) : 0;
+
+      printf("  0x%-16llx", entry->key);
+      for(o=0; o<PROFILE_OUTCOMES; o++)
+	{
+	  printf(" %10llu", outcomes[o]);
+	}
+      printf(" %9.4f %9.4f %9llu\n", coverage, accuracy, entry->error);
+    }
+}
+
+extern "C" void __wrap_l2_prefetcher_final_stats(int cpu_num)
+{
+  __real_l2_prefetcher_final_stats(cpu_num);
+
+  printf("Attribution profile for engine %s\n", PROFILE_ENGINE);
+  printf("Totals:");
+  int o;
+  for(o=0; o<PROFILE_OUTCOMES; o++)
+    {
+      printf(" %s %llu", profile_outcome_names[o], outcome_totals[o]);
+    }
+  printf("\n");
+  printf("Counts for each key may be under-reported by up to its error, from keys it replaced in the table\n");
+
+  print_top("IPs by misses", ip_table, PROFILE_MISS, -1);
+  print_top("IPs by coverage (covered misses)", ip_table, PROFILE_COVERED, -1);
+  print_top("IPs by pollution (useless + polluting prefetches)", ip_table, PROFILE_USELESS, PROFILE_POLLUTING);
+  print_top("pages by misses", page_table, PROFILE_MISS, -1);
+  print_top("pages by coverage (covered misses)", page_table, PROFILE_COVERED, -1);
+  print_top("pages by pollution (useless + polluting prefetches)", page_table, PROFILE_USELESS, PROFILE_POLLUTING);
+}
@@ -0,0 +1,108 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file does NOT implement any prefetcher.  It is linked between the
+  simulator and a prefetcher, with the linker's --wrap option (see the
+  record_calls-% rule in the Makefile), and records every call the
+  simulator makes into the prefetcher, along with the simulator state a
+  prefetcher can query, so that the calls can be replayed by sim_stub.cc.
+
+  Recording with a prefetcher that prefetches into the L2 captures the
+  l2_cache_fill() calls for prefetched lines, as well as demand fills.
+  Recording with the skeleton captures demand traffic alone.
+
+  The calls are written to the file named by the DPC2_CALL_LOG environment
+  variable (default calls.txt).  Recording stops after DPC2_CALL_LIMIT
+  l2_prefetcher_operate() calls (default 20000).
+
+  Each line is one call:
+    O <cycle> <mshr occupancy> <read queue occupancy> <addr> <ip> <cache_hit>
+    F <cycle> <mshr occupancy> <read queue occupancy> <addr> <set> <way> <prefetch> <evicted_addr>
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../inc/prefetcher.h"
+
+FILE *call_log;
+long long int call_limit;
+long long int operate_calls;
+
+extern "C" {
+void __real_l2_prefetcher_initialize(int cpu_num);
+void __real_l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit);
+void __real_l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr);
+void __real_l2_prefetcher_final_stats(int cpu_num);
+}
+
+extern "C" void __wrap_l2_prefetcher_initialize(int cpu_num)
+{
+  printf("Recording prefetcher calls\n");
+
+  const char *log_name = getenv("DPC2_CALL_LOG");
+  if(log_name == NULL)
+    {
+      log_name = "calls.txt";
+    }
+  call_log = fopen(log_name, "w");
+  if(call_log == NULL)
+    {
+      printf("Couldn't open call log %s. Exiting.\n", log_name);
+      exit(1);
+    }
+
+  call_limit = 20000;
+  if(getenv("DPC2_CALL_LIMIT") != NULL)
+    {
+      call_limit = atoll(getenv("DPC2_CALL_LIMIT"));
+    }
+  operate_calls = 0;
+
+  __real_l2_prefetcher_initialize(cpu_num);
+}
+
+extern "C" void __wrap_l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  if(operate_calls < call_limit)
+    {
+      operate_calls++;
+
+      fprintf(call_log, "O %llu %d %d 0x%llx 0x%llx %d\n", get_current_cycle(0), get_l2_mshr_occupancy(0), get_l2_read_queue_occupancy(0),
+	      addr, ip, cache_hit);
+
+      if(operate_calls == call_limit)
+	{
+	  fclose(call_log);
+	  call_log = NULL;
+	}
+    }
+
+  __real_l2_prefetcher_operate(cpu_num, addr, ip, cache_hit);
+}
+
+extern "C" void __wrap_l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  if(call_log != NULL)
+    {
+      fprintf(call_log, "F %llu %d %d 0x%llx %d %d %d 0x%llx\n", get_current_cycle(0), get_l2_mshr_occupancy(0), get_l2_read_queue_occupancy(0),
+	      addr, set, way, prefetch, evicted_addr);
+    }
+
+  __real_l2_cache_fill(cpu_num, addr, set, way, prefetch, evicted_addr);
+}
+
+extern "C" void __wrap_l2_prefetcher_final_stats(int cpu_num)
+{
+  if(call_log != NULL)
+    {
+      fclose(call_log);
+      call_log = NULL;
+    }
+  printf("Recorded %lld l2_prefetcher_operate calls\n", operate_calls);
+
+  __real_l2_prefetcher_final_stats(cpu_num);
+}
@@ -0,0 +1,242 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file stands in for the simulator when testing a prefetcher.  It is
+  linked with a single prefetcher .cc file instead of lib/dpc2sim.a, reads a
+  call sequence recorded by record_calls.cc from stdin, and replays it into
+  the prefetcher.
+
+  The simulator functions a prefetcher may call return the cycle and
+  occupancies recorded with each call.  The stub keeps a copy of the L2
+  tags, filled from the set, way and address of each recorded
+  l2_cache_fill() call, so that l2_get_way() finds the lines the
+  simulator held at that point.  Every l2_prefetch_line() call is
+  printed to stdout along with the index of the call that issued it, so
+  that the prefetch stream can be compared against a golden output.
+
+  With -budget <ns>, the call sequence is instead replayed -repeat times
+  (default 20) with the prefetch stream discarded, and the average cost of
+  each call is printed to stderr.  The exit status is 1 if that cost is
+  above the budget.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../inc/prefetcher.h"
+
+typedef struct recorded_call
+{
+  // 'O' for l2_prefetcher_operate, 'F' for l2_cache_fill
+  char type;
+
+  unsigned long long int cycle;
+  int mshr_occupancy;
+  int read_queue_occupancy;
+
+  unsigned long long int addr;
+  // the ip for operate calls, or the evicted address for fill calls
+  unsigned long long int ip;
+  // cache_hit for operate calls, or prefetch for fill calls
+  int hit;
+  int set;
+  int way;
+} recorded_call_t;
+
+recorded_call_t *calls;
+long long int call_count;
+
+// simulator state seen by the prefetcher during the current call
+const recorded_call_t *current_call;
+long long int current_index;
+int print_prefetches;
+unsigned long long int prefetch_count;
+
+// the line held by each L2 way, as of the last recorded fill, 0 if empty
+unsigned long long int l2_lines[L2_SET_COUNT][L2_ASSOCIATIVITY];
+
+int knob_low_bandwidth = 0;
+int knob_small_llc = 0;
+int knob_scramble_loads = 0;
+
+unsigned long long int get_current_cycle(int cpu_num)
+{
+  return current_call ? current_call->cycle : 0;
+}
+
+int get_l2_mshr_occupancy(int cpu_num)
+{
+  return current_call ? current_call->mshr_occupancy : 0;
+}
+
+int get_l2_read_queue_occupancy(int cpu_num)
+{
+  return current_call ? current_call->read_queue_occupancy : 0;
+}
+
+int l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  prefetch_count++;
+
+  if((base_addr>>12) != (pf_addr>>12))
+    {
+      // the simulator would reject this prefetch, so make it show up in the output
+      if(print_prefetches)
+	{
+	  printf("%lld CROSS_PAGE 0x%llx 0x%llx %d\n", current_index, base_addr, pf_addr, fill_level);
+	}
+      return 0;
+    }
+
+  if(print_prefetches)
+    {
+      printf("%lld 0x%llx 0x%llx %d\n", current_index, base_addr, pf_addr, fill_level);
+    }
+  return 1;
+}
+
+int l2_get_set(unsigned long long int addr)
+{
+  return (addr>>6) & (L2_SET_COUNT-1);
+}
+
+int l2_get_way(int cpu_num, unsigned long long int addr, int set)
+{
+  unsigned long long int line = addr>>6;
+  int way;
+  for(way=0; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(l2_lines[set][way] == line)
+	{
+	  return way;
+	}
+    }
+  return -1;
+}
+
+void read_calls()
+{
+  long long int capacity = 1<<16;
+  calls = (recorded_call_t *)malloc(capacity * sizeof(recorded_call_t));
+  call_count = 0;
+
+  char line[256];
+  while(fgets(line, sizeof(line), stdin) != NULL)
+    {
+      if(call_count == capacity)
+	{
+	  capacity *= 2;
+	  calls = (recorded_call_t *)realloc(calls, capacity * sizeof(recorded_call_t));
+	}
+
+      recorded_call_t *call = &calls[call_count];
+      memset(call, 0, sizeof(recorded_call_t));
+      call->type = line[0];
+
+      int fields = 0;
+      if(call->type == 'O')
+	{
+	  fields = sscanf(line+1, "%llu %d %d %llx %llx %d", &call->cycle, &call->mshr_occupancy, &call->read_queue_occupancy,
+			  &call->addr, &call->ip, &call->hit);
+	}
+      else if(call->type == 'F')
+	{
+	  fields = sscanf(line+1, "%llu %d %d %llx %d %d %d %llx", &call->cycle, &call->mshr_occupancy, &call->read_queue_occupancy,
+			  &call->addr, &call->set, &call->way, &call->hit, &call->ip);
+	  fields -= 2;
+	  if((call->set < 0) || (call->set >= L2_SET_COUNT) || (call->way < 0) || (call->way >= L2_ASSOCIATIVITY))
+	    {
+	      fields = 0;
+	    }
+	}
+
+      if(fields != 6)
+	{
+	  fprintf(stderr, "Bad call record: %s", line);
+	  exit(1);
+	}
+      call_count++;
+    }
+}
+
+void replay_calls()
+{
+  memset(l2_lines, 0, sizeof(l2_lines));
+  for(current_index=0; current_index<call_count; current_index++)
+    {
+      current_call = &calls[current_index];
+      if(current_call->type == 'O')
+	{
+	  l2_prefetcher_operate(0, current_call->addr, current_call->ip, current_call->hit);
+	}
+      else
+	{
+	  l2_lines[current_call->set][current_call->way] = current_call->addr>>6;
+	  l2_cache_fill(0, current_call->addr, current_call->set, current_call->way, current_call->hit, current_call->ip);
+	}
+    }
+  current_call = NULL;
+}
+
+int main(int argc, char **argv)
+{
+  double budget = 0;
+  int repeat = 20;
+
+  int i;
+  for(i=1; i<argc; i++)
+    {
+      if((strcmp(argv[i], "-budget") == 0) && (i+1 < argc))
+	{
+	  budget = atof(argv[++i]);
+	}
+      else if((strcmp(argv[i], "-repeat") == 0) && (i+1 < argc))
+	{
+	  repeat = atoi(argv[++i]);
+	}
+      else
+	{
+	  fprintf(stderr, "Usage: %s [-budget <ns per call>] [-repeat <number>] < calls.txt\n", argv[0]);
+	  return 1;
+	}
+    }
+
+  read_calls();
+
+  if(budget <= 0)
+    {
+      print_prefetches = 1;
+      l2_prefetcher_initialize(0);
+      replay_calls();
+      l2_prefetcher_final_stats(0);
+      return 0;
+    }
+
+  // keep the prefetcher's own printing out of the timing
+  fflush(stdout);
+  int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, 1);
+
+  l2_prefetcher_initialize(0);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i=0; i<repeat; i++)
+    {
+      replay_calls();
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (end.tv_sec-start.tv_sec)*1e9 + (end.tv_nsec-start.tv_nsec);
+  double ns_per_call = ns / ((double)call_count * repeat);
+  fprintf(stderr, "%f ns/call over %lld calls x %d, budget %f ns/call\n", ns_per_call, call_count, repeat, budget);
+
+  return (ns_per_call > budget) ? 1 : 0;
+}
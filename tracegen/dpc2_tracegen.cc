@@ -0,0 +1,438 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a synthetic trace generator.  It writes DPC2 trace
+  records for simple parameterized kernels, so that prefetchers can be
+  tested on known access patterns without needing Pin and dpc2_tracer.so.
+
+  The trace is written to stdout by default, so it can be piped straight
+  into the simulator.  If stdout is a terminal and no -o file is given,
+  the usage is printed instead:
+
+  ./dpc2_tracegen -kernel stride -stride 128 | ./dpc2sim-stream
+
+  Each trace record is 48 bytes:
+    8 bytes   instruction pointer
+    1 byte    destination register (0 for none)
+    3 bytes   source registers (0 for none)
+    4 bytes   unused
+    8 bytes   destination (store) memory address (0 for none)
+    24 bytes  three source (load) memory addresses (0 for none)
+
+  Every memory instruction is followed by -alu non-memory instructions,
+  which depend on the value it loaded.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct trace_record
+{
+  unsigned long long int ip;
+  unsigned char destination_register;
+  unsigned char source_registers[3];
+  unsigned char unused[4];
+  unsigned long long int destination_memory;
+  unsigned long long int source_memory[3];
+} trace_record_t;
+
+typedef char trace_record_must_be_48_bytes[(sizeof(trace_record_t) == 48) ? 1 : -1];
+
+// records are written in batches of this many
+#define RECORD_BUFFER_SIZE 8192
+
+// every kernel's data lives above this address, and the code lives at CODE_BASE
+#define DATA_BASE 0x10000000ULL
+#define CODE_BASE 0x400000ULL
+
+// registers 1-15 are used as address registers, and 16-31 for loaded values
+#define VALUE_REGISTER_BASE 16
+#define VALUE_REGISTER_COUNT 16
+
+enum kernel_type
+  {
+    KERNEL_STRIDE,
+    KERNEL_STREAMS,
+    KERNEL_RANDOM,
+    KERNEL_CHASE,
+    KERNEL_STENCIL,
+    KERNEL_GATHER,
+    KERNEL_MIX,
+    KERNEL_COUNT
+  };
+
+const char *kernel_names[KERNEL_COUNT] = { "stride", "streams", "random", "chase", "stencil", "gather", "mix" };
+
+// command line parameter defaults
+#define DEFAULT_INSTRUCTION_COUNT 10000000ULL
+#define DEFAULT_STRIDE 64LL
+#define DEFAULT_STREAM_COUNT 4
+#define DEFAULT_FOOTPRINT (64ULL<<20)
+#define DEFAULT_ROW_SIZE 4096ULL
+#define DEFAULT_PHASE_LENGTH 1000000ULL
+#define DEFAULT_ALU_COUNT 2
+#define DEFAULT_SEED 1ULL
+
+// command line parameters
+int kernel = KERNEL_STRIDE;
+unsigned long long int instruction_count = DEFAULT_INSTRUCTION_COUNT;
+long long int stride = DEFAULT_STRIDE;
+int stream_count = DEFAULT_STREAM_COUNT;
+unsigned long long int footprint = DEFAULT_FOOTPRINT;
+unsigned long long int row_size = DEFAULT_ROW_SIZE;
+unsigned long long int phase_length = DEFAULT_PHASE_LENGTH;
+int alu_count = DEFAULT_ALU_COUNT;
+unsigned long long int seed = DEFAULT_SEED;
+const char *output_name = NULL;
+
+// output state
+FILE *output;
+trace_record_t record_buffer[RECORD_BUFFER_SIZE];
+int record_count;
+unsigned long long int instructions_written;
+int value_register;
+
+// per-kernel state, which persists across phases of the mix kernel
+unsigned long long int stride_index;
+unsigned long long int stream_index[256];
+int stream_next;
+unsigned long long int random_state;
+unsigned long long int chase_line;
+unsigned long long int stencil_index;
+unsigned long long int gather_index;
+
+void flush_records()
+{
+  if(record_count > 0)
+    {
+      if(fwrite(record_buffer, sizeof(trace_record_t), record_count, output) != (size_t)record_count)
+	{
+	  fprintf(stderr, "Couldn't write trace output. Exiting.\n");
+	  exit(1);
+	}
+      record_count = 0;
+    }
+}
+
+trace_record_t *next_record(unsigned long long int ip)
+{
+  if(record_count == RECORD_BUFFER_SIZE)
+    {
+      flush_records();
+    }
+
+  trace_record_t *record = &record_buffer[record_count];
+  record_count++;
+  instructions_written++;
+
+  memset(record, 0, sizeof(trace_record_t));
+  record->ip = ip;
+  return record;
+}
+
+// non-memory instructions that consume a loaded value
+void emit_alu(unsigned long long int ip, int source_register)
+{
+  int i;
+  for(i=0; i<alu_count; i++)
+    {
+      trace_record_t *record = next_record(ip + 4*(i+1));
+      record->destination_register = source_register;
+      record->source_registers[0] = source_register;
+    }
+}
+
+// emits a load, and returns the register holding the loaded value
+int emit_load(unsigned long long int ip, unsigned long long int addr, int address_register)
+{
+  int destination_register = VALUE_REGISTER_BASE + value_register;
+  value_register = (value_register+1) % VALUE_REGISTER_COUNT;
+
+  trace_record_t *record = next_record(ip);
+  record->destination_register = destination_register;
+  record->source_registers[0] = address_register;
+  record->source_memory[0] = addr;
+
+  emit_alu(ip, destination_register);
+  return destination_register;
+}
+
+void emit_store(unsigned long long int ip, unsigned long long int addr, int value_register)
+{
+  trace_record_t *record = next_record(ip);
+  record->source_registers[0] = value_register;
+  record->destination_memory = addr;
+
+  emit_alu(ip, value_register);
+}
+
+// byte offset of element index at the given stride, wrapped into [0, size)
+unsigned long long int wrap_offset(unsigned long long int index, long long int stride, unsigned long long int size)
+{
+  long long int offset = ((long long int)index * stride) % (long long int)size;
+  if(offset < 0)
+    {
+      offset += size;
+    }
+  return offset;
+}
+
+// xorshift64, which is plenty random for address generation
+unsigned long long int next_random()
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+// one load per iteration, at a fixed stride that wraps around the footprint
+void kernel_stride()
+{
+  unsigned long long int addr = DATA_BASE + wrap_offset(stride_index, stride, footprint);
+  emit_load(CODE_BASE + 0x100, addr, 1);
+  stride_index++;
+}
+
+// several interleaved sequential streams, each with its own IP and its own slice of the footprint
+void kernel_streams()
+{
+  unsigned long long int slice = footprint / stream_count;
+  int s = stream_next;
+  stream_next = (stream_next+1) % stream_count;
+
+  unsigned long long int addr = DATA_BASE + s*slice + wrap_offset(stream_index[s], stride, slice);
+  emit_load(CODE_BASE + 0x1000 + s*0x40, addr, 1 + (s%15));
+  stream_index[s]++;
+}
+
+// uniformly random cache lines within the footprint
+void kernel_random()
+{
+  unsigned long long int line = next_random() % (footprint>>6);
+  emit_load(CODE_BASE + 0x2000, DATA_BASE + (line<<6), 1);
+}
+
+// a linked list walk, where each load's address depends on the previous load's value
+void kernel_chase()
+{
+  // a full-period LCG over a power of two number of lines visits every line once,
+  // in a scrambled order, without storing the list
+  unsigned long long int lines = 1;
+  while((lines<<1) <= (footprint>>6))
+    {
+      lines <<= 1;
+    }
+  chase_line = (chase_line*6364136223846793005ULL + 1442695040888963407ULL) & (lines-1);
+
+  // the address register is the same register the load writes, which serializes the walk
+  trace_record_t *record = next_record(CODE_BASE + 0x3000);
+  record->destination_register = VALUE_REGISTER_BASE;
+  record->source_registers[0] = VALUE_REGISTER_BASE;
+  record->source_memory[0] = DATA_BASE + (chase_line<<6);
+
+  // the non-memory instructions work on a separate register, so they stay off the critical path
+  emit_alu(CODE_BASE + 0x3000, VALUE_REGISTER_BASE + 1);
+}
+
+// b[i] = a[i-row] + a[i] + a[i+row] over 8-byte elements, with a and b each taking half the footprint
+void kernel_stencil()
+{
+  unsigned long long int elements = (footprint/2) / 8;
+  unsigned long long int row = row_size / 8;
+  if(elements <= 2*row)
+    {
+      row = 1;
+    }
+  unsigned long long int i = row + (stencil_index % (elements - 2*row));
+  unsigned long long int a = DATA_BASE;
+  unsigned long long int b = DATA_BASE + footprint/2;
+
+  int v0 = emit_load(CODE_BASE + 0x4000, a + 8*(i-row), 1);
+  emit_load(CODE_BASE + 0x4040, a + 8*i, 1);
+  emit_load(CODE_BASE + 0x4080, a + 8*(i+row), 1);
+  emit_store(CODE_BASE + 0x40c0, b + 8*i, v0);
+  stencil_index++;
+}
+
+// x += data[index[i]], with a sequential 4-byte index array and random data lines
+void kernel_gather()
+{
+  unsigned long long int index_bytes = footprint / 16;
+  unsigned long long int data_lines = (footprint - index_bytes) >> 6;
+
+  unsigned long long int index_addr = DATA_BASE + ((gather_index*4) % index_bytes);
+  int index_register = emit_load(CODE_BASE + 0x5000, index_addr, 1);
+
+  unsigned long long int line = next_random() % data_lines;
+  emit_load(CODE_BASE + 0x5040, DATA_BASE + index_bytes + (line<<6), index_register);
+  gather_index++;
+}
+
+void run_kernel(int k)
+{
+  switch(k)
+    {
+    case KERNEL_STRIDE:
+      kernel_stride();
+      break;
+    case KERNEL_STREAMS:
+      kernel_streams();
+      break;
+    case KERNEL_RANDOM:
+      kernel_random();
+      break;
+    case KERNEL_CHASE:
+      kernel_chase();
+      break;
+    case KERNEL_STENCIL:
+      kernel_stencil();
+      break;
+    case KERNEL_GATHER:
+      kernel_gather();
+      break;
+    case KERNEL_MIX:
+      // switch to the next basic kernel every phase_length instructions
+      run_kernel((instructions_written / phase_length) % KERNEL_MIX);
+      break;
+    }
+}
+
+void print_usage()
+{
+  fprintf(stderr, "Usage: dpc2_tracegen [options]\n");
+  fprintf(stderr, "  -kernel <name>        stride, streams, random, chase, stencil, gather or mix (default stride)\n");
+  fprintf(stderr, "  -t <number>           number of instructions to generate (default %llu)\n", DEFAULT_INSTRUCTION_COUNT);
+  fprintf(stderr, "  -stride <bytes>       stride for stride and streams kernels, may be negative (default %lld)\n", DEFAULT_STRIDE);
+  fprintf(stderr, "  -streams <number>     number of streams for the streams kernel, at most 256 (default %d)\n", DEFAULT_STREAM_COUNT);
+  fprintf(stderr, "  -footprint <bytes>    size of the data touched by the kernel (default %llu)\n", DEFAULT_FOOTPRINT);
+  fprintf(stderr, "  -row <bytes>          row size for the stencil kernel (default %llu)\n", DEFAULT_ROW_SIZE);
+  fprintf(stderr, "  -phase <number>       instructions per phase for the mix kernel (default %llu)\n", DEFAULT_PHASE_LENGTH);
+  fprintf(stderr, "  -alu <number>         non-memory instructions after each memory instruction (default %d)\n", DEFAULT_ALU_COUNT);
+  fprintf(stderr, "  -seed <number>        random seed (default %llu)\n", DEFAULT_SEED);
+  fprintf(stderr, "  -o <file>             output file (default stdout, which must not be a terminal)\n");
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+  for(i=1; i<argc; i++)
+    {
+      if((i+1 >= argc) || (argv[i][0] != '-'))
+	{
+	  print_usage();
+	  return 1;
+	}
+
+      const char *option = argv[i];
+      const char *value = argv[++i];
+
+      if(strcmp(option, "-kernel") == 0)
+	{
+	  kernel = -1;
+	  int k;
+	  for(k=0; k<KERNEL_COUNT; k++)
+	    {
+	      if(strcmp(value, kernel_names[k]) == 0)
+		{
+		  kernel = k;
+		}
+	    }
+	  if(kernel == -1)
+	    {
+	      fprintf(stderr, "Unknown kernel %s\n", value);
+	      print_usage();
+	      return 1;
+	    }
+	}
+      else if(strcmp(option, "-t") == 0)
+	{
+	  instruction_count = strtoull(value, NULL, 0);
+	}
+      else if(strcmp(option, "-stride") == 0)
+	{
+	  stride = strtoll(value, NULL, 0);
+	}
+      else if(strcmp(option, "-streams") == 0)
+	{
+	  stream_count = atoi(value);
+	}
+      else if(strcmp(option, "-footprint") == 0)
+	{
+	  footprint = strtoull(value, NULL, 0);
+	}
+      else if(strcmp(option, "-row") == 0)
+	{
+	  row_size = strtoull(value, NULL, 0);
+	}
+      else if(strcmp(option, "-phase") == 0)
+	{
+	  phase_length = strtoull(value, NULL, 0);
+	}
+      else if(strcmp(option, "-alu") == 0)
+	{
+	  alu_count = atoi(value);
+	}
+      else if(strcmp(option, "-seed") == 0)
+	{
+	  seed = strtoull(value, NULL, 0);
+	}
+      else if(strcmp(option, "-o") == 0)
+	{
+	  output_name = value;
+	}
+      else
+	{
+	  fprintf(stderr, "Unknown option %s\n", option);
+	  print_usage();
+	  return 1;
+	}
+    }
+
+  if((stream_count < 1) || (stream_count > 256) || (footprint < 4096) || (alu_count < 0) || (phase_length == 0))
+    {
+      fprintf(stderr, "Invalid parameters\n");
+      print_usage();
+      return 1;
+    }
+
+  // a trace is hundreds of megabytes of binary, so don't write it to a terminal
+  if((output_name == NULL) && isatty(fileno(stdout)))
+    {
+      print_usage();
+      return 1;
+    }
+
+  output = stdout;
+  if(output_name != NULL)
+    {
+      output = fopen(output_name, "wb");
+      if(output == NULL)
+	{
+	  fprintf(stderr, "Couldn't open output trace file. Exiting.\n");
+	  return 1;
+	}
+    }
+
+  random_state = seed ? seed : 1;
+  chase_line = seed;
+
+  while(instructions_written < instruction_count)
+    {
+      run_kernel(kernel);
+    }
+
+  flush_records();
+  if(output != stdout)
+    {
+      fclose(output);
+    }
+
+  return 0;
+}